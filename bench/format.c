@@ -0,0 +1,67 @@
+/*
+ * Compares formatting doubles with SLOGFormatTo against snprintf.
+ *
+ * Every format is run over the same table of pseudo random values and
+ * the average time per call is printed. SLOGFormatTo's %g prints the
+ * shortest round trip digits, so it is compared against %.17g, the
+ * shortest snprintf format that round trips every double.
+ */
+#define SLOG_IMPLEMENTATION
+#include "Shroon/Logger/Logger.h"
+
+#include <stdio.h>
+
+#define BENCH_VALUES 1024
+#define BENCH_CALLS  2000000
+
+int main()
+{
+    static const char * formats[][2] = {
+        { "%g", "%.17g" },
+        { "%.3f", "%.3f" },
+        { "%.6e", "%.6e" },
+        { "%f", "%f" }
+    };
+
+    static double values[BENCH_VALUES];
+
+    char buf[64];
+
+    uint64_t state = 1;
+    size_t total = 0;
+
+    int i;
+    int k;
+
+    for (i = 0; i < BENCH_VALUES; i++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        values[i] = (double)(state >> 40) / (double)(1 + (state & 0xFFFF));
+    }
+
+    for (k = 0; k < (int)(sizeof(formats) / sizeof(formats[0])); k++)
+    {
+        uint64_t start = SLOG_InternalNow();
+        uint64_t middle;
+        uint64_t end;
+
+        for (i = 0; i < BENCH_CALLS; i++)
+            total += SLOGFormatTo(buf, sizeof(buf), formats[k][0], values[i % BENCH_VALUES]);
+
+        middle = SLOG_InternalNow();
+
+        for (i = 0; i < BENCH_CALLS; i++)
+            total += (size_t)snprintf(buf, sizeof(buf), formats[k][1], values[i % BENCH_VALUES]);
+
+        end = SLOG_InternalNow();
+
+        printf("%-5s SLOGFormatTo %7.1f ns   snprintf %-6s %7.1f ns\n",
+            formats[k][0], (double)(middle - start) / BENCH_CALLS,
+            formats[k][1], (double)(end - middle) / BENCH_CALLS);
+    }
+
+    /*
+     * Keep the calls from being optimized away.
+     */
+    return total == 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Measures how logging through the asynchronous queue scales with threads.
+ *
+ * For 1, 2, 4, ... 64 threads, every thread writes the same number of
+ * deferred logs to a temporary file. The time until every thread queued
+ * its logs and the time until the last one was written are measured, and the
+ * total throughput and the throughput of each thread are printed for every
+ * thread count. Queueing scales with the threads until the writer thread,
+ * which formats and writes every log, is saturated.
+ */
+#define SLOG_IMPLEMENTATION
+#include "Shroon/Logger/Logger.h"
+
+#include <stdio.h>
+
+#define BENCH_THREADS 64
+#define BENCH_LOGS    200000
+
+static SLOG_INTERNAL_THREAD_RESULT Run(void * arg)
+{
+    size_t id = (size_t)arg;
+
+    int i;
+
+    for (i = 0; i < BENCH_LOGS; i++)
+        SLOG_INFO("thread %u log %d value %f\n", (unsigned)id, i, i * 0.5);
+
+    return 0;
+}
+
+int main()
+{
+    static SLOG_InternalThread threads[BENCH_THREADS];
+
+    SLOGConfig config;
+
+    size_t count;
+    size_t i;
+
+    SLOGGetDefaultConfig(&config);
+    config.Async = 1;
+    config.Deferred = 1;
+    config.QueueSize = 65536;
+
+    printf("%7s %14s %14s %14s %14s\n", "threads", "queued/s", "queued/s/th", "written/s", "written/s/th");
+
+    for (count = 1; count <= BENCH_THREADS; count *= 2)
+    {
+        FILE * out = tmpfile();
+
+        uint64_t start;
+        uint64_t queued;
+        uint64_t end;
+
+        double total = (double)count * BENCH_LOGS;
+
+        if (!out)
+        {
+            perror("tmpfile");
+            return 1;
+        }
+
+        SLOGInitWithConfig(&config);
+        SLOGSetColorMode(SLOG_COLOR_NEVER);
+        SLOGSetOutputFile(out);
+
+        start = SLOG_InternalNow();
+
+        for (i = 0; i < count; i++)
+        {
+            if (!SLOG_InternalThreadStart(&threads[i], Run, (void *)i))
+            {
+                fprintf(stderr, "Failed to start thread %u.\n", (unsigned)i);
+                return 1;
+            }
+        }
+
+        for (i = 0; i < count; i++)
+            SLOG_InternalThreadJoin(threads[i]);
+
+        queued = SLOG_InternalNow();
+
+        SLOGFlush();
+
+        end = SLOG_InternalNow();
+
+        SLOGShutdown();
+        fclose(out);
+
+        printf("%7u %14.0f %14.0f %14.0f %14.0f\n", (unsigned)count,
+            total * 1e9 / (double)(queued - start), total * 1e9 / (double)(queued - start) / count,
+            total * 1e9 / (double)(end - start), total * 1e9 / (double)(end - start) / count);
+    }
+
+    return 0;
+}
@@ -1,6 +1,22 @@
 #ifndef SHROON_LOGGER_H
 #define SHROON_LOGGER_H
 
+/*
+ * The implementation needs POSIX.1-2008 and a few BSD extensions (clocks,
+ * sigaltstack, gethostname, ...) which glibc hides in the strict -std=c99 and
+ * -std=c11 modes. Request them before the first system header unless the user
+ * already picked a feature set.
+ */
+#if defined(SLOG_IMPLEMENTATION) && defined(__linux__)
+    #if !defined(_POSIX_C_SOURCE) && !defined(_XOPEN_SOURCE) && !defined(_GNU_SOURCE)
+        #define _POSIX_C_SOURCE 200809L
+    #endif
+
+    #ifndef _DEFAULT_SOURCE
+        #define _DEFAULT_SOURCE
+    #endif
+#endif
+
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -13,6 +29,14 @@
 #include <Shroon/Utils/String.h>
 #include <Shroon/Utils/Vector.h>
 
+#ifndef va_copy
+    #ifdef __va_copy
+        #define va_copy(dst, src) __va_copy(dst, src)
+    #else
+        #define va_copy(dst, src) ((dst) = (src))
+    #endif
+#endif
+
 /*
  * @brief Return a formatted string.
  *
@@ -22,15 +46,345 @@
  */
 char * SLOGFormat(const char * fmt, ...);
 
+/**
+ * @brief Return a formatted string.
+ *
+ * @param fmt The format using which output will be generated.
+ * @param ap The arguments of \p fmt.
+ *
+ * @return A <tt>char *</tt> allocated using \p SHRN_MALLOC containing the formatted string.
+ */
+char * SLOGVFormat(const char * fmt, va_list ap);
+
+/**
+ * @brief Write a formatted string to a caller provided buffer.
+ *
+ * Never allocates. If the output doesn't fit it is truncated, \p buf is
+ * always null terminated as long as \p cap isn't 0.
+ *
+ * @param buf The buffer where the output will be written.
+ * @param cap The size of \p buf in bytes, including the null terminator.
+ * @param fmt The format using which output will be generated.
+ *
+ * @return The length of the complete formatted string, excluding the null terminator.
+ */
+size_t SLOGFormatTo(char * buf, size_t cap, const char * fmt, ...);
+
+/**
+ * @brief Write a formatted string to a caller provided buffer.
+ *
+ * @param buf The buffer where the output will be written.
+ * @param cap The size of \p buf in bytes, including the null terminator.
+ * @param fmt The format using which output will be generated.
+ * @param ap The arguments of \p fmt.
+ *
+ * @return The length of the complete formatted string, excluding the null terminator.
+ *
+ * @see SLOGFormatTo
+ */
+size_t SLOGVFormatTo(char * buf, size_t cap, const char * fmt, va_list ap);
+
+/**
+ * @brief A format compiled by \p SLOGCompileFormat.
+ */
+typedef struct SLOGFormatProgram SLOGFormatProgram;
+
+/**
+ * @brief Compile a format so it doesn't have to be parsed on every use.
+ *
+ * Literal text is copied and color sequences are pre-rendered into the
+ * program, so \p fmt doesn't need to outlive it.
+ *
+ * @param fmt The format to compile.
+ *
+ * @return A program allocated using \p SHRN_MALLOC, free it with \p SLOGFreeFormat, or NULL if the allocation failed.
+ */
+SLOGFormatProgram * SLOGCompileFormat(const char * fmt);
+
+/**
+ * @brief Free a program returned by \p SLOGCompileFormat.
+ *
+ * @param program The program to free.
+ */
+void SLOGFreeFormat(SLOGFormatProgram * program);
+
+/**
+ * @brief Compile a format into \p cache unless it already holds a program.
+ *
+ * @param cache Where the program is cached, must be initialized to NULL.
+ * @param fmt The format to compile.
+ *
+ * @return The cached program, or NULL if it couldn't be allocated. Later calls try again.
+ */
+const SLOGFormatProgram * SLOGCompileFormatOnce(SLOGFormatProgram ** cache, const char * fmt);
+
+/**
+ * @brief Return a string formatted by a compiled format.
+ *
+ * @param program The compiled format using which output will be generated.
+ *
+ * @return A <tt>char *</tt> allocated using \p SHRN_MALLOC containing the formatted string.
+ */
+char * SLOGFormatCompiled(const SLOGFormatProgram * program, ...);
+
+/**
+ * @brief Return a string formatted by a compiled format.
+ *
+ * @param program The compiled format using which output will be generated.
+ * @param ap The arguments of \p program.
+ *
+ * @return A <tt>char *</tt> allocated using \p SHRN_MALLOC containing the formatted string.
+ */
+char * SLOGVFormatCompiled(const SLOGFormatProgram * program, va_list ap);
+
+/**
+ * @brief Write a string formatted by a compiled format to a caller provided buffer.
+ *
+ * @param program The compiled format using which output will be generated.
+ * @param buf The buffer where the output will be written.
+ * @param cap The size of \p buf in bytes, including the null terminator.
+ *
+ * @return The length of the complete formatted string, excluding the null terminator.
+ *
+ * @see SLOGFormatTo
+ */
+size_t SLOGFormatCompiledTo(const SLOGFormatProgram * program, char * buf, size_t cap, ...);
+
+/**
+ * @brief Write a string formatted by a compiled format to a caller provided buffer.
+ *
+ * @param program The compiled format using which output will be generated.
+ * @param buf The buffer where the output will be written.
+ * @param cap The size of \p buf in bytes, including the null terminator.
+ * @param ap The arguments of \p program.
+ *
+ * @return The length of the complete formatted string, excluding the null terminator.
+ *
+ * @see SLOGFormatTo
+ */
+size_t SLOGVFormatCompiledTo(const SLOGFormatProgram * program, char * buf, size_t cap, va_list ap);
+
+/**
+ * @brief Write a formatted string to a caller provided buffer, compiling \p fmt into \p cache on first use.
+ *
+ * @param cache Where the compiled format is cached, must be initialized to NULL.
+ * @param buf The buffer where the output will be written.
+ * @param cap The size of \p buf in bytes, including the null terminator.
+ * @param fmt The format using which output will be generated.
+ *
+ * @return The length of the complete formatted string, excluding the null terminator, or 0 if the format couldn't be compiled.
+ *
+ * @see SLOGFormatTo
+ */
+size_t SLOGFormatCachedTo(SLOGFormatProgram ** cache, char * buf, size_t cap, const char * fmt, ...);
+
+/**
+ * @brief Write a formatted string to a caller provided buffer, compiling the format once per call site.
+ *
+ * @param result Receives the length of the complete formatted string.
+ * @param buf The buffer where the output will be written.
+ * @param cap The size of \p buf in bytes, including the null terminator.
+ * @param ... The format followed by its arguments.
+ */
+#define SLOG_FORMAT_TO(result, buf, cap, ...) \
+    do\
+    {\
+        static SLOGFormatProgram * slogProgram = NULL;\
+        (result) = SLOGFormatCachedTo(&slogProgram, buf, cap, __VA_ARGS__);\
+    } while (0)
+
+/**
+ * @brief Built-in levels used by the \p SLOG_TRACE ... \p SLOG_FATAL macros.
+ */
+#define SLOG_LEVEL_TRACE 0
+#define SLOG_LEVEL_DEBUG 1
+#define SLOG_LEVEL_INFO  2
+#define SLOG_LEVEL_WARN  3
+#define SLOG_LEVEL_ERROR 4
+#define SLOG_LEVEL_FATAL 5
+
+/**
+ * @brief Number of built-in levels.
+ */
+#define SLOG_LEVEL_COUNT 6
+
+/**
+ * @brief What a log does when the asynchronous queue is full, see \p SLOGConfig::FullPolicy.
+ */
+enum SLOGFullPolicy
+{
+    SLOG_FULL_BLOCK,        /**< Wait for room, spinning briefly before sleeping. */
+    SLOG_FULL_DROP,         /**< Drop the log. */
+    SLOG_FULL_DROP_EARLY    /**< Drop the log once the queue is 3/4 full, leaving the rest to logs of the other policies. */
+};
+
+/**
+ * @brief Clocks of \p SLOGConfig::Clock.
+ */
+enum SLOGClock
+{
+    SLOG_CLOCK_REALTIME,        /**< The precise wall clock. */
+    SLOG_CLOCK_REALTIME_COARSE, /**< The wall clock at the resolution of the scheduler tick, cheaper to read where available. */
+    SLOG_CLOCK_TSC              /**< The time stamp counter of x86 processors calibrated against the wall clock, the coarse wall clock elsewhere. */
+};
+
+/**
+ * @brief How logs are rendered, see \p SLOGConfig::Encoding and \p SLOGSink::Encoding.
+ */
+enum SLOGEncoding
+{
+    SLOG_ENCODING_TEXT,     /**< '<prefix> <message>' followed by ' key=value' for each field. */
+    SLOG_ENCODING_JSON,     /**< One JSON object per line with "ts", "level", "msg" and a member for each field. */
+    SLOG_ENCODING_LOGFMT    /**< 'ts=<time> level=<level> site=<file>:<line> msg=<message>' followed by ' key=value' for each field. Values with spaces, quotes or '=' are quoted. */
+};
+
+/**
+ * @brief Configuration of the logger, see \p SLOGInitWithConfig.
+ */
+typedef struct SLOGConfig
+{
+    int Async;                  /**< Write logs from a background thread instead of the logging thread. */
+    size_t QueueSize;           /**< Number of logs the asynchronous queue holds, rounded up to a power of 2. */
+    size_t RecordSize;          /**< Maximum size of a queued log in bytes, larger logs wait for the queue to drain and are written synchronously. */
+    unsigned FlushIntervalMs;   /**< How long the background thread waits for new logs before flushing. With \p FlushSize, logs buffered for longer are written by the next log. */
+    int Deferred;               /**< With \p Async, queue the format and raw arguments of SLOG_* logs and format them on the background thread. */
+    int Binary;                 /**< Write compact binary entries instead of text, turned back into text by slog-decode. */
+    size_t FlushSize;           /**< Buffer up to this many bytes of logs in the logger and write them with one system call, 0 leaves buffering to the output file. */
+    int FlushLevel;             /**< Logs at or above this level are written out, with every log before them, before the logging call returns. */
+    int FullPolicy[SLOG_LEVEL_COUNT]; /**< One of \p SLOGFullPolicy for each built-in level, other levels use the policy of the closest one. Dropped logs are reported by a warning. */
+    int Clock;                  /**< One of \p SLOGClock, the times of logs never go back within a thread. */
+    int TimestampDigits;        /**< Start logs with their UTC time as YYYY-MM-DDTHH:MM:SS, followed by this many digits of the second from 1 to 9 and Z, in "ts" with JSON. 0 writes no fraction, -1 no timestamp. */
+    int Encoding;               /**< One of \p SLOGEncoding for the output file, ignored with \p Binary. */
+    size_t ArenaSize;           /**< Size of the arena every thread formats its logs in, see \p SLOGSetThreadArena. */
+    int Preallocate;            /**< Allocate everything logging needs up front so logs never allocate, see \p SLOGGetStats. */
+    size_t Threads;             /**< With \p Preallocate, number of threads that can log at the same time without allocating. */
+    size_t SiteMemory;          /**< With \p Preallocate, bytes kept for the compiled formats and call sites of SLOG_* logs. */
+} SLOGConfig;
+
+/**
+ * @brief Fill \p config with the configuration used by \p SLOGInit.
+ *
+ * @param config The configuration to fill.
+ */
+void SLOGGetDefaultConfig(SLOGConfig * config);
+
 /**
  * @brief Initialize the logger state.
  */
 void SLOGInit();
 
+/**
+ * @brief Initialize the logger state with a configuration.
+ *
+ * When \p SLOGConfig::Async is set, logs are copied into a bounded queue and
+ * written in batches by a background thread. Logging threads only wait when
+ * the queue is full.
+ *
+ * When \p SLOGConfig::FlushSize is set, the logger buffers logs itself and
+ * writes them to the file descriptor of the output file with one gathering
+ * write once the buffer is full, a log of at least \p SLOGConfig::FlushLevel
+ * arrives or \p SLOGConfig::FlushIntervalMs passed. Output written to the file
+ * through stdio is flushed before each of those writes.
+ *
+ * @param config The configuration of the logger.
+ */
+void SLOGInitWithConfig(const SLOGConfig * config);
+
+/**
+ * @brief Wait until every log written so far reached the output file.
+ */
+void SLOGFlush();
+
+/**
+ * @brief Write pending logs and stop the background thread.
+ *
+ * No other thread may be logging while this runs. Called automatically at exit.
+ */
+void SLOGShutdown();
+
+/**
+ * @brief Write logs that are still queued or buffered by the logger straight to the output file.
+ *
+ * Only uses async-signal-safe calls and never allocates, so it can be called
+ * from a signal handler when the program is about to die. Logs being
+ * written by the background thread at the same time may be written twice.
+ * Output buffered by stdio, used when \p SLOGConfig::FlushSize is 0, can't
+ * be written safely and is left alone.
+ */
+void SLOGEmergencyFlush();
+
+/**
+ * @brief Install handlers for SIGSEGV, SIGABRT, SIGBUS and SIGFPE that call \p SLOGEmergencyFlush.
+ *
+ * The handlers restore the previous handler and raise the signal again
+ * afterwards, so the program still dies, or reaches the previous handler,
+ * as it would have. The calling thread also gets an alternate signal stack
+ * so a stack overflow can be handled.
+ */
+void SLOGInstallCrashHandler();
+
+/**
+ * @brief An arena the temporaries of logs are taken from.
+ *
+ * Everything a log takes is given back at once by \p Reset after the log is
+ * written. An arena is only used by the thread it was set for.
+ */
+typedef struct SLOGArena
+{
+    void * (*Alloc)(void * user, size_t size);  /**< Return \p size bytes aligned to 16, or NULL when the arena is full. */
+    void (*Reset)(void * user);                 /**< Give back everything returned by \p Alloc. */
+    void * User;                                /**< Passed to \p Alloc and \p Reset. */
+} SLOGArena;
+
+/**
+ * @brief Take the temporaries of the logs of the calling thread from \p arena.
+ *
+ * By default every thread formats its logs in an arena of
+ * \p SLOGConfig::ArenaSize bytes, allocated on its first log. Temporaries
+ * that don't fit, such as a log larger than the arena, are allocated using
+ * \p SHRN_MALLOC and freed when the log is written.
+ *
+ * Strings returned by \p SLOGFormat and friends belong to the caller and
+ * are never taken from the arena.
+ *
+ * @param arena The arena to use, copied. NULL goes back to the built-in arena.
+ */
+void SLOGSetThreadArena(const SLOGArena * arena);
+
+/**
+ * @brief Counters of the logger, see \p SLOGGetStats.
+ */
+typedef struct SLOGStats
+{
+    size_t Allocations;         /**< Allocations made by logs since \p SLOGInitWithConfig. */
+    size_t AllocatedBytes;      /**< Bytes requested by \p Allocations. */
+    size_t PreallocatedBytes;   /**< Bytes allocated up front for \p SLOGConfig::Preallocate. */
+} SLOGStats;
+
+/**
+ * @brief Fill \p stats with the counters of the logger.
+ *
+ * Logs allocate the state of a thread on its first log, the arena of the
+ * thread, temporaries larger than the arena and the compiled format and
+ * registration of an SLOG_* call site on its first use. With
+ * \p SLOGConfig::Preallocate the states of \p SLOGConfig::Threads threads,
+ * their arenas and \p SLOGConfig::SiteMemory bytes for call sites are
+ * allocated by \p SLOGInitWithConfig instead, and \p SLOGStats::Allocations
+ * stays 0 as long as they suffice. Allocations that are still needed are
+ * made and counted, and fail an assertion unless NDEBUG is defined.
+ *
+ * Sinks keep their own memory and aren't counted.
+ *
+ * @param stats The counters to fill.
+ */
+void SLOGGetStats(SLOGStats * stats);
+
 /**
  * @brief Set filter level of the logger.
  *
- * @param level The minimum level logs should be to get written.
+ * Sinks added by \p SLOGAddSink have levels of their own.
+ *
+ * @param level The minimum level logs should be to get written to the output file.
  */
 void SLOGSetLogFilterLevel(int level);
 
@@ -41,113 +395,665 @@ void SLOGSetLogFilterLevel(int level);
  */
 void SLOGSetOutputFile(FILE * f);
 
+/**
+ * @brief Modes of \p SLOGSetColorMode.
+ */
+enum SLOGColorMode
+{
+    SLOG_COLOR_AUTO,    /**< Write colors only if the output file is a terminal. */
+    SLOG_COLOR_ALWAYS,
+    SLOG_COLOR_NEVER
+};
+
+/**
+ * @brief Set whether color sequences are written by the formatting functions.
+ *
+ * Defaults to \p SLOG_COLOR_AUTO. Define \p SLOG_NO_COLOR to compile colors out entirely.
+ *
+ * @param mode One of \p SLOGColorMode.
+ */
+void SLOGSetColorMode(int mode);
+
 /**
  * @brief Write a log.
  *
+ * All logging functions can be called from any thread. Every log is written
+ * with a single write to the output file, so logs of different threads are
+ * never interleaved.
+ *
  * @param level The level of this log.
  * @param prefix The prefix of this log. Usually used for string representation of \p level.
  * @param msg The main content of the log.
  */
 void SLOGLog(int level, const char * prefix, const char * msg);
 
-#define SLOG_IMPLEMENTATION
+/**
+ * @brief Types of \p SLOGField values.
+ */
+enum SLOGFieldType
+{
+    SLOG_FIELD_INT,
+    SLOG_FIELD_UINT,
+    SLOG_FIELD_FLOAT,
+    SLOG_FIELD_BOOL,
+    SLOG_FIELD_STRING
+};
 
-#ifdef SLOG_IMPLEMENTATION
-    /*
-     * Define this if you want to use custom implementations
-     * of fmod, SHRN_POW and log2 or don't want to use "math.h".
-     *
-     * It will work without custom implementations, but the
-     * performance of the logger might be affected.
-     */
-    #ifdef SHRN_NO_USE_MATH_H
-        #ifndef SHRN_CEIL
-            double SHRN_InternalCeil(double x);
+/**
+ * @brief A typed key-value pair of a structured log, see \p SLOGLogFields.
+ */
+typedef struct SLOGField
+{
+    const char * Key;
+    int Type;   /**< One of \p SLOGFieldType, selecting the member of \p Value. */
 
-            #ifdef SLOG_IMPLEMENTATION
-                double SHRN_InternalCeil(double x)
-                {
-                    double frac = (x < 0 ? -x : x) - (long long)x;
+    union
+    {
+        int64_t Int;
+        uint64_t Uint;
+        double Float;
+        int Bool;
+        const char * String;
+    } Value;
+} SLOGField;
 
-                    if (frac > 0)
-                        return (long long)x + 1;
-                    else
-                        return x;
-                }
-            #endif
+/**
+ * @brief Make a field, the key and strings must stay valid until the log is written.
+ */
+SLOGField SLOGFieldInt(const char * key, int64_t value);
+SLOGField SLOGFieldUint(const char * key, uint64_t value);
+SLOGField SLOGFieldFloat(const char * key, double value);
+SLOGField SLOGFieldBool(const char * key, int value);
+SLOGField SLOGFieldString(const char * key, const char * value);
 
-            #define SHRN_CEIL(x) SHRN_InternalCeil(x)
-        #endif
+/**
+ * @brief Write a log with the built-in prefix of \p level and typed fields.
+ *
+ * Values are rendered straight into the log, as ' key=value' after the
+ * message in text and as members of the object in JSON. A newline at the
+ * end of \p msg is optional.
+ *
+ * @param level The level of this log.
+ * @param msg The main content of the log.
+ * @param fields The fields of the log.
+ * @param count The number of fields.
+ */
+void SLOGLogFields(int level, const char * msg, const SLOGField * fields, size_t count);
 
-        #ifndef SHRN_POW
-            double SHRN_InternalPow(double base, double exp);
+/**
+ * @brief Marks the end of the fields passed to \p SLOGLogFieldList, as does any field with a NULL key.
+ */
+extern const SLOGField SLOGFieldEnd;
 
-            #ifdef SLOG_IMPLEMENTATION
-                double SHRN_InternalPow(double base, double exp)
-                {
-                    long long i = 0;
-                    size_t j = 0;
+/**
+ * @brief The minimum level logs should be to get written to the output file, set by \p SLOGSetLogFilterLevel.
+ *
+ * Only exposed so the logging macros can check it without a call.
+ */
+extern int SLOGLogFilterLevel;
 
-                    double res = 1.0;
+/**
+ * @brief Function receiving the logs of a sink, see \p SLOGAddSink.
+ *
+ * @param user The \p SLOGSink::User of the sink.
+ * @param level The level of the log.
+ * @param data The rendered log.
+ * @param size The size of \p data in bytes.
+ */
+typedef void (*SLOGSinkFunc)(void * user, int level, const char * data, size_t size);
 
-                    /* Integer part */
-                    for (i = 0; i < exp; i++)
-                        res *= base;
+/**
+ * @brief A destination for logs besides the output file.
+ */
+typedef struct SLOGSink
+{
+    SLOGSinkFunc Write; /**< Called with every log the sink accepts, from the logging thread. */
+    void * User;        /**< Passed to \p Write. */
+    size_t Levels;      /**< Levels the sink accepts, bit n for level n, see \p SLOG_LEVELS_FROM. */
+    int Color;          /**< Whether logs are rendered with color sequences, only used by \p SLOG_ENCODING_TEXT. */
+    int Encoding;       /**< One of \p SLOGEncoding. */
+} SLOGSink;
 
-                    /* Fractional part */
-                    double frac = exp - (long long)exp;
+/**
+ * @brief \p SLOGSink::Levels accepting \p level and every level above it.
+ *
+ * Levels below 0 share bit 0 and levels above 31 share bit 31.
+ */
+#define SLOG_LEVELS_FROM(level) ((size_t)0xFFFFFFFFu & ~(size_t)(SLOG_INTERNAL_LEVEL_BIT(level) - 1))
 
-                    double tmp = sqrt(base);
-                    double po2 = 2.0;
+#define SLOG_INTERNAL_LEVEL_BIT(level) ((size_t)1 << ((level) < 0 ? 0 : (level) > 31 ? 31 : (level)))
 
-                    for (j = 0; j < 46; j++)
-                    {
-                        double npo2 = 1.0 / po2;
+/**
+ * @brief Maximum number of sinks added at once.
+ */
+#define SLOG_MAX_SINKS 8
 
-                        if (frac >= npo2)
-                            res *= tmp;
+/**
+ * @brief Add a sink receiving every log of its levels, independent of the filter level.
+ *
+ * Logs are rendered at most once with and once without colors, whatever the
+ * number of sinks. In binary mode sinks still receive text.
+ *
+ * @param sink The sink, copied by the logger.
+ *
+ * @return A handle for \p SLOGRemoveSink, or -1 if \p SLOG_MAX_SINKS sinks are added already.
+ */
+int SLOGAddSink(const SLOGSink * sink);
 
-                        if (frac == npo2):
-                            break;
+/**
+ * @brief Remove a sink added by \p SLOGAddSink.
+ *
+ * No other thread may be logging while this runs.
+ *
+ * @param sink The handle returned by \p SLOGAddSink.
+ */
+void SLOGRemoveSink(int sink);
 
-                        tmp = sqrt(tmp);
-                        po2 *= 2.0;
-                    }
+/**
+ * @brief A \p SLOGSinkFunc writing to the \p FILE passed as \p user.
+ */
+void SLOGSinkWriteFile(void * user, int level, const char * data, size_t size);
 
-                    return res;
-                }
-            #endif
+/**
+ * @brief A sink writing logs into memory mapped log files, see \p SLOGOpenMapSink.
+ */
+typedef struct SLOGMapSink SLOGMapSink;
 
-            #define SHRN_POW(x, y) SHRN_InternalPow(x, y)
-        #endif
-    #else
-        #include <math.h>
+/**
+ * @brief Open a sink that copies logs straight into memory mapped segments of a log.
+ *
+ * Segments are files named \p path followed by a dot and the number of the
+ * segment, starting at 0. Each is preallocated to \p segmentSize bytes and
+ * mapped into memory, so logging threads only reserve space with an atomic
+ * addition and copy the log, without a system call. Once a segment is full,
+ * logs continue in the next one and the full one is cut to the logs it holds.
+ *
+ * Logs in a mapped segment survive a crash of the program. The last segment
+ * of a program that didn't call \p SLOGCloseMapSink ends with zero bytes.
+ * Logs larger than \p segmentSize are dropped.
+ *
+ * Add the sink with \p SLOGMapSinkWrite as \p SLOGSink::Write and the
+ * returned sink as \p SLOGSink::User.
+ *
+ * @param path The path of the log, without the segment number.
+ * @param segmentSize The size of each segment in bytes.
+ *
+ * @return The sink, or NULL if the first segment couldn't be created.
+ */
+SLOGMapSink * SLOGOpenMapSink(const char * path, size_t segmentSize);
 
-        #define SHRN_CEIL(x)          ceil(x)
-        #define SHRN_POW(base, exp)   pow(base, exp)
-    #endif
+/**
+ * @brief Cut the current segment to the logs it holds and free \p sink.
+ *
+ * Remove the sink with \p SLOGRemoveSink first.
+ *
+ * @param sink The sink returned by \p SLOGOpenMapSink.
+ */
+void SLOGCloseMapSink(SLOGMapSink * sink);
 
-    /*
-     * Define this only if you want to use custom implementations
-     * of malloc, realloc and free.
-     */
-    #ifdef SHRN_NO_USE_STDLIB_H
-        #ifndef SHRN_MALLOC
-            #error `SHRN_MALLOC` must be defined if `SHRN_NO_USE_STDLIB_H` is defined.
-        #endif
+/**
+ * @brief A \p SLOGSinkFunc writing to the \p SLOGMapSink passed as \p user.
+ */
+void SLOGMapSinkWrite(void * user, int level, const char * data, size_t size);
 
-        #ifndef SHRN_REALLOC
-            #error `SHRN_REALLOC` must be defined if `SHRN_NO_USE_STDLIB_H` is defined.
-        #endif
+/**
+ * @brief When a \p SLOGRotatingSink starts a new file.
+ */
+typedef struct SLOGRotation
+{
+    size_t MaxSize;     /**< Rotate once the file reached this many bytes, 0 to never rotate by size. */
+    unsigned Interval;  /**< Rotate every this many seconds, counted from midnight UTC, 0 to never rotate by time. */
+    unsigned MaxFiles;  /**< Number of rotated files kept, named after the file followed by .1 for the newest to .MaxFiles. */
+} SLOGRotation;
 
-        #ifndef SHRN_FREE
-            #error `SHRN_FREE` must be defined if `SHRN_NO_USE_STDLIB_H` is defined.
-        #endif
-    #else
-        #include <stdlib.h>
+/**
+ * @brief A sink appending logs to a file that is rotated by size or time, see \p SLOGOpenRotatingSink.
+ */
+typedef struct SLOGRotatingSink SLOGRotatingSink;
 
-        #define SHRN_MALLOC(size)           malloc(size)
-        #define SHRN_REALLOC(oldptr, size)  realloc(oldptr, size)
+/**
+ * @brief Open a sink appending logs to \p path and rotating it.
+ *
+ * Files are renamed and opened by a background thread, logging threads keep
+ * writing to the previous file until the new one is ready and never wait for
+ * a rotation. Files may grow a little past \p SLOGRotation::MaxSize while
+ * the rotation is under way.
+ *
+ * Add the sink with \p SLOGRotatingSinkWrite as \p SLOGSink::Write and the
+ * returned sink as \p SLOGSink::User.
+ *
+ * @param path The path of the file, logs are appended if it exists.
+ * @param rotation When to rotate the file.
+ *
+ * @return The sink, or NULL if the file couldn't be opened.
+ */
+SLOGRotatingSink * SLOGOpenRotatingSink(const char * path, const SLOGRotation * rotation);
+
+/**
+ * @brief Close the file of \p sink and free it.
+ *
+ * Remove the sink with \p SLOGRemoveSink first.
+ *
+ * @param sink The sink returned by \p SLOGOpenRotatingSink.
+ */
+void SLOGCloseRotatingSink(SLOGRotatingSink * sink);
+
+/**
+ * @brief Rotate the file of \p sink now, for example on SIGHUP.
+ *
+ * @param sink The sink returned by \p SLOGOpenRotatingSink.
+ */
+void SLOGRotateSink(SLOGRotatingSink * sink);
+
+/**
+ * @brief A \p SLOGSinkFunc writing to the \p SLOGRotatingSink passed as \p user.
+ */
+void SLOGRotatingSinkWrite(void * user, int level, const char * data, size_t size);
+
+/**
+ * @brief Protocols of \p SLOGOpenSyslogSink.
+ */
+enum SLOGSyslogProtocol
+{
+    SLOG_SYSLOG_RFC5424,    /**< RFC 5424 messages for the syslog daemon, sent to /dev/log by default. */
+    SLOG_SYSLOG_JOURNALD    /**< The native protocol of systemd-journald, sent to /run/systemd/journal/socket by default. */
+};
+
+/**
+ * @brief A sink sending logs to the local syslog daemon or journald, see \p SLOGOpenSyslogSink.
+ */
+typedef struct SLOGSyslogSink SLOGSyslogSink;
+
+/**
+ * @brief Open a sink sending logs as datagrams over a Unix domain socket.
+ *
+ * Levels map to syslog severities: trace and debug to debug (7), info to
+ * informational (6), warnings to warning (4), errors to error (3) and
+ * fatal errors to critical (2). RFC 5424 messages carry no timestamp, the
+ * daemon stamps them as they arrive. A newline ending a log is removed and
+ * logs are cut to 8 KiB.
+ *
+ * Logs are collected and sent in batches with one sendmmsg call by a
+ * background thread every \p SLOGConfig::FlushIntervalMs, when a batch is
+ * full, or right away from \p SLOGConfig::FlushLevel on. Logging threads
+ * never send or wait: logs arriving while a full batch waits for the
+ * thread to send the other one are dropped. Without threads every log is
+ * sent right away. Logs the daemon has no room for are dropped, and when
+ * the daemon restarts the socket is connected again, at most once a second
+ * while it is away.
+ *
+ * Add the sink with \p SLOGSyslogSinkWrite as \p SLOGSink::Write and the
+ * returned sink as \p SLOGSink::User. Not available on Windows.
+ *
+ * @param path The socket, or NULL for the default of \p protocol.
+ * @param protocol One of \p SLOGSyslogProtocol.
+ * @param ident The name of the program in the logs, or NULL for none.
+ * @param facility The syslog facility from 0 to 23, 1 for user-level messages, 16 to 23 for local0 to local7.
+ *
+ * @return The sink, or NULL if it couldn't be created. A daemon that isn't running yet only delays the logs.
+ */
+SLOGSyslogSink * SLOGOpenSyslogSink(const char * path, int protocol, const char * ident, int facility);
+
+/**
+ * @brief Send the logs collected by \p sink, close its socket and free it.
+ *
+ * Remove the sink with \p SLOGRemoveSink first.
+ *
+ * @param sink The sink returned by \p SLOGOpenSyslogSink.
+ */
+void SLOGCloseSyslogSink(SLOGSyslogSink * sink);
+
+/**
+ * @brief Number of logs \p sink dropped because the daemon was away or had no room for them.
+ *
+ * @param sink The sink returned by \p SLOGOpenSyslogSink.
+ */
+size_t SLOGGetSyslogSinkDropped(const SLOGSyslogSink * sink);
+
+/**
+ * @brief A \p SLOGSinkFunc sending to the \p SLOGSyslogSink passed as \p user.
+ */
+void SLOGSyslogSinkWrite(void * user, int level, const char * data, size_t size);
+
+/**
+ * @brief Union of the \p SLOGSink::Levels of every sink.
+ *
+ * Only exposed so the logging macros can check it without a call.
+ */
+extern size_t SLOGSinkLevels;
+
+/**
+ * @brief The lowest level the output file or any sink takes, kept up to date from \p SLOGLogFilterLevel and \p SLOGSinkLevels.
+ *
+ * Only exposed so the logging macros can check it without a call.
+ */
+extern int SLOGEnabledLevel;
+
+/*
+ * Read the filter level, sink levels, lowest enabled level and whether a
+ * site is disabled, they may be changed by another thread at any time.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+    #define SLOG_INTERNAL_FILTER_LEVEL() __atomic_load_n(&SLOGLogFilterLevel, __ATOMIC_RELAXED)
+    #define SLOG_INTERNAL_SINK_LEVELS()  __atomic_load_n(&SLOGSinkLevels, __ATOMIC_RELAXED)
+    #define SLOG_INTERNAL_ENABLED_LEVEL() __atomic_load_n(&SLOGEnabledLevel, __ATOMIC_RELAXED)
+    #define SLOG_INTERNAL_SITE_DISABLED(site) __atomic_load_n(&(site).Disabled, __ATOMIC_RELAXED)
+#else
+    #define SLOG_INTERNAL_FILTER_LEVEL() (*(volatile int *)&SLOGLogFilterLevel)
+    #define SLOG_INTERNAL_SINK_LEVELS()  (*(volatile size_t *)&SLOGSinkLevels)
+    #define SLOG_INTERNAL_ENABLED_LEVEL() (*(volatile int *)&SLOGEnabledLevel)
+    #define SLOG_INTERNAL_SITE_DISABLED(site) (*(volatile int *)&(site).Disabled)
+#endif
+
+/*
+ * Whether the output file or any sink may take logs of 'level', with a
+ * single compare. Sinks taking some levels above their lowest one only are
+ * checked by SLOG_INTERNAL_TAKEN once the log reaches the logger.
+ */
+#define SLOG_INTERNAL_ENABLED(level) ((level) >= SLOG_INTERNAL_ENABLED_LEVEL())
+
+/*
+ * Whether the output file or any sink takes logs of 'level'.
+ */
+#define SLOG_INTERNAL_TAKEN(level) ((level) >= SLOG_INTERNAL_FILTER_LEVEL() || (SLOG_INTERNAL_SINK_LEVELS() & SLOG_INTERNAL_LEVEL_BIT(level)))
+
+/**
+ * @brief Write a log with the built-in prefix of \p level, compiling \p fmt into \p cache on first use.
+ *
+ * Used by the \p SLOG_TRACE ... \p SLOG_FATAL macros, which also check the filter level.
+ *
+ * @param level One of the \p SLOG_LEVEL_* levels.
+ * @param cache Where the compiled format is cached, must be initialized to NULL.
+ * @param fmt The format of the main content of the log.
+ */
+void SLOGLogCached(int level, SLOGFormatProgram ** cache, const char * fmt, ...);
+
+/**
+ * @brief Metadata of a logging call site, registered by its first log.
+ *
+ * Every \p SLOG_TRACE ... \p SLOG_FATAL call site has one. Fields other
+ * than \p Disabled never change once \p Id is set.
+ */
+typedef struct SLOGSite
+{
+    const char * File;
+    int Line;
+    const char * Function;
+    int Level;
+    const char * Format;            /**< The format of the first log of the site, its message for \p SLOG_INFO_FIELDS and friends. */
+    SLOGFormatProgram * Program;    /**< The compiled \p Format, NULL for \p SLOG_INFO_FIELDS and friends. */
+    size_t Id;                      /**< 0 until the site is registered, then its index in the registry starting at 1, or (size_t)-1 while registering or if the registry is full. */
+    int Disabled;                   /**< Set by \p SLOGSetSiteEnabled. */
+    const char * Logfmt;            /**< 'site=<file>:<line> ' of \p SLOG_ENCODING_LOGFMT, rendered on registration. */
+    size_t LogfmtSize;
+} SLOGSite;
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+    #define SLOG_INTERNAL_FUNCTION __func__
+#elif defined(__GNUC__) || defined(_MSC_VER)
+    #define SLOG_INTERNAL_FUNCTION __FUNCTION__
+#else
+    #define SLOG_INTERNAL_FUNCTION ""
+#endif
+
+#define SLOG_INTERNAL_SITE_INIT(level) { __FILE__, __LINE__, SLOG_INTERNAL_FUNCTION, level, NULL, NULL, 0, 0, NULL, 0 }
+
+/**
+ * @brief Write a log of \p site, registering the site on first use.
+ *
+ * Used by the \p SLOG_TRACE ... \p SLOG_FATAL macros, which also check the
+ * filter level and whether the site is disabled.
+ *
+ * @param site The metadata of the call site, initialized by \p SLOG_INTERNAL_SITE_INIT.
+ * @param fmt The format of the main content of the log.
+ */
+void SLOGLogSite(SLOGSite * site, const char * fmt, ...);
+
+/**
+ * @brief Write a log of \p site like \p SLOGLogFields, with the fields passed as arguments.
+ *
+ * Used by the SLOG_<level>_FIELDS macros, which also check the filter
+ * level and whether the site is disabled.
+ *
+ * @param site The metadata of the call site, initialized by \p SLOG_INTERNAL_SITE_INIT.
+ * @param msg The main content of the log.
+ * @param ... The fields of the log, followed by \p SLOGFieldEnd.
+ */
+void SLOGLogFieldList(SLOGSite * site, const char * msg, ...);
+
+/**
+ * @brief Number of registered call sites, their ids go from 1 to this.
+ */
+size_t SLOGGetSiteCount();
+
+/**
+ * @brief Find a registered call site.
+ *
+ * @param id The \p SLOGSite::Id of the site.
+ *
+ * @return The site, or NULL if no site has \p id.
+ */
+const SLOGSite * SLOGGetSite(size_t id);
+
+/**
+ * @brief Enable or disable the logs of a registered call site at runtime.
+ *
+ * Sites register on their first log, so a site can only be disabled once it logged.
+ *
+ * @param id The \p SLOGSite::Id of the site.
+ * @param enabled Whether the site writes logs.
+ */
+void SLOGSetSiteEnabled(size_t id, int enabled);
+
+/**
+ * @brief State of a rate limited call site, see \p SLOG_ERROR_LIMITED.
+ */
+typedef struct SLOGRateLimit
+{
+    const SLOGSite * Site;
+    size_t Limit;
+    unsigned IntervalMs;
+    size_t Start;       /**< Start of the current interval in milliseconds. */
+    size_t Count;       /**< Logs of the site in the current interval. */
+    size_t Listed;      /**< Whether the site is in the list of sites with suppressed logs. */
+    struct SLOGRateLimit * Next;
+} SLOGRateLimit;
+
+#define SLOG_INTERNAL_RATE_LIMIT_INIT(site) { site, 0, 0, 0, 0, 0, NULL }
+
+/**
+ * @brief Count a log of \p site and check whether it is over the limit.
+ *
+ * Used by the \p SLOG_TRACE_LIMITED ... \p SLOG_FATAL_LIMITED macros. Once
+ * an interval with suppressed logs ended, the next log of the site, or the
+ * next \p SLOGFlush or \p SLOGShutdown, writes how many logs were suppressed.
+ *
+ * @param site The state of the call site.
+ * @param limit The number of logs written per interval.
+ * @param intervalMs The length of an interval in milliseconds.
+ *
+ * @return Nonzero if the log must be suppressed.
+ */
+int SLOGRateLimited(SLOGRateLimit * site, size_t limit, unsigned intervalMs);
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define SLOG_LIKELY(x)   __builtin_expect(!!(x), 1)
+    #define SLOG_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+    #define SLOG_LIKELY(x)   (x)
+    #define SLOG_UNLIKELY(x) (x)
+#endif
+
+/**
+ * @brief Levels below this are compiled out of the \p SLOG_TRACE ... \p SLOG_FATAL macros.
+ */
+#ifndef SLOG_COMPILE_MIN_LEVEL
+    #define SLOG_COMPILE_MIN_LEVEL SLOG_LEVEL_TRACE
+#endif
+
+/*
+ * The arguments are only evaluated when the output file or a sink takes 'level'.
+ */
+#define SLOG_INTERNAL_LOG(level, ...) \
+    do\
+    {\
+        if (SLOG_UNLIKELY(SLOG_INTERNAL_ENABLED(level)))\
+        {\
+            static SLOGSite slogSite = SLOG_INTERNAL_SITE_INIT(level);\
+            if (!SLOG_INTERNAL_SITE_DISABLED(slogSite))\
+                SLOGLogSite(&slogSite, __VA_ARGS__);\
+        }\
+    } while (0)
+
+/*
+ * The limit is checked before the arguments are evaluated or formatted.
+ */
+#define SLOG_INTERNAL_LOG_LIMITED(level, limit, intervalMs, ...) \
+    do\
+    {\
+        if (SLOG_UNLIKELY(SLOG_INTERNAL_ENABLED(level)))\
+        {\
+            static SLOGSite slogSite = SLOG_INTERNAL_SITE_INIT(level);\
+            static SLOGRateLimit slogLimit = SLOG_INTERNAL_RATE_LIMIT_INIT(&slogSite);\
+            if (!SLOG_INTERNAL_SITE_DISABLED(slogSite) && !SLOGRateLimited(&slogLimit, limit, intervalMs))\
+                SLOGLogSite(&slogSite, __VA_ARGS__);\
+        }\
+    } while (0)
+
+/*
+ * The fields are only evaluated when the output file or a sink takes 'level'.
+ */
+#define SLOG_INTERNAL_LOG_FIELDS(level, msg, ...) \
+    do\
+    {\
+        if (SLOG_UNLIKELY(SLOG_INTERNAL_ENABLED(level)))\
+        {\
+            static SLOGSite slogSite = SLOG_INTERNAL_SITE_INIT(level);\
+            if (!SLOG_INTERNAL_SITE_DISABLED(slogSite))\
+                SLOGLogFieldList(&slogSite, msg, __VA_ARGS__, SLOGFieldEnd);\
+        }\
+    } while (0)
+
+#define SLOG_INTERNAL_LOG_FIELDS_LIMITED(level, limit, intervalMs, msg, ...) \
+    do\
+    {\
+        if (SLOG_UNLIKELY(SLOG_INTERNAL_ENABLED(level)))\
+        {\
+            static SLOGSite slogSite = SLOG_INTERNAL_SITE_INIT(level);\
+            static SLOGRateLimit slogLimit = SLOG_INTERNAL_RATE_LIMIT_INIT(&slogSite);\
+            if (!SLOG_INTERNAL_SITE_DISABLED(slogSite) && !SLOGRateLimited(&slogLimit, limit, intervalMs))\
+                SLOGLogFieldList(&slogSite, msg, __VA_ARGS__, SLOGFieldEnd);\
+        }\
+    } while (0)
+
+/**
+ * @brief Define this to limit every \p SLOG_TRACE ... \p SLOG_FATAL and \p SLOG_INFO_FIELDS style call site to this many logs per \p SLOG_RATE_INTERVAL_MS.
+ *
+ * The \p *_LIMITED macros take limits of their own.
+ */
+#ifdef SLOG_RATE_LIMIT
+    #ifndef SLOG_RATE_INTERVAL_MS
+        #define SLOG_RATE_INTERVAL_MS 1000
+    #endif
+
+    #undef SLOG_INTERNAL_LOG
+    #define SLOG_INTERNAL_LOG(level, ...) SLOG_INTERNAL_LOG_LIMITED(level, SLOG_RATE_LIMIT, SLOG_RATE_INTERVAL_MS, __VA_ARGS__)
+
+    #undef SLOG_INTERNAL_LOG_FIELDS
+    #define SLOG_INTERNAL_LOG_FIELDS(level, msg, ...) SLOG_INTERNAL_LOG_FIELDS_LIMITED(level, SLOG_RATE_LIMIT, SLOG_RATE_INTERVAL_MS, msg, __VA_ARGS__)
+#endif
+
+/*
+ * SLOG_<level>_LIMITED(limit, intervalMs, fmt, ...) writes at most 'limit'
+ * logs of the call site every 'intervalMs' milliseconds, see SLOGRateLimited.
+ *
+ * SLOG_<level>_FIELDS(msg, field, ...) writes 'msg' with fields made by
+ * SLOGFieldInt and friends, see SLOGLogFields.
+ */
+#if SLOG_COMPILE_MIN_LEVEL <= SLOG_LEVEL_TRACE
+    #define SLOG_TRACE(...) SLOG_INTERNAL_LOG(SLOG_LEVEL_TRACE, __VA_ARGS__)
+    #define SLOG_TRACE_LIMITED(limit, intervalMs, ...) SLOG_INTERNAL_LOG_LIMITED(SLOG_LEVEL_TRACE, limit, intervalMs, __VA_ARGS__)
+    #define SLOG_TRACE_FIELDS(msg, ...) SLOG_INTERNAL_LOG_FIELDS(SLOG_LEVEL_TRACE, msg, __VA_ARGS__)
+#else
+    #define SLOG_TRACE(...) ((void)0)
+    #define SLOG_TRACE_LIMITED(limit, intervalMs, ...) ((void)0)
+    #define SLOG_TRACE_FIELDS(msg, ...) ((void)0)
+#endif
+
+#if SLOG_COMPILE_MIN_LEVEL <= SLOG_LEVEL_DEBUG
+    #define SLOG_DEBUG(...) SLOG_INTERNAL_LOG(SLOG_LEVEL_DEBUG, __VA_ARGS__)
+    #define SLOG_DEBUG_LIMITED(limit, intervalMs, ...) SLOG_INTERNAL_LOG_LIMITED(SLOG_LEVEL_DEBUG, limit, intervalMs, __VA_ARGS__)
+    #define SLOG_DEBUG_FIELDS(msg, ...) SLOG_INTERNAL_LOG_FIELDS(SLOG_LEVEL_DEBUG, msg, __VA_ARGS__)
+#else
+    #define SLOG_DEBUG(...) ((void)0)
+    #define SLOG_DEBUG_LIMITED(limit, intervalMs, ...) ((void)0)
+    #define SLOG_DEBUG_FIELDS(msg, ...) ((void)0)
+#endif
+
+#if SLOG_COMPILE_MIN_LEVEL <= SLOG_LEVEL_INFO
+    #define SLOG_INFO(...) SLOG_INTERNAL_LOG(SLOG_LEVEL_INFO, __VA_ARGS__)
+    #define SLOG_INFO_LIMITED(limit, intervalMs, ...) SLOG_INTERNAL_LOG_LIMITED(SLOG_LEVEL_INFO, limit, intervalMs, __VA_ARGS__)
+    #define SLOG_INFO_FIELDS(msg, ...) SLOG_INTERNAL_LOG_FIELDS(SLOG_LEVEL_INFO, msg, __VA_ARGS__)
+#else
+    #define SLOG_INFO(...) ((void)0)
+    #define SLOG_INFO_LIMITED(limit, intervalMs, ...) ((void)0)
+    #define SLOG_INFO_FIELDS(msg, ...) ((void)0)
+#endif
+
+#if SLOG_COMPILE_MIN_LEVEL <= SLOG_LEVEL_WARN
+    #define SLOG_WARN(...) SLOG_INTERNAL_LOG(SLOG_LEVEL_WARN, __VA_ARGS__)
+    #define SLOG_WARN_LIMITED(limit, intervalMs, ...) SLOG_INTERNAL_LOG_LIMITED(SLOG_LEVEL_WARN, limit, intervalMs, __VA_ARGS__)
+    #define SLOG_WARN_FIELDS(msg, ...) SLOG_INTERNAL_LOG_FIELDS(SLOG_LEVEL_WARN, msg, __VA_ARGS__)
+#else
+    #define SLOG_WARN(...) ((void)0)
+    #define SLOG_WARN_LIMITED(limit, intervalMs, ...) ((void)0)
+    #define SLOG_WARN_FIELDS(msg, ...) ((void)0)
+#endif
+
+#if SLOG_COMPILE_MIN_LEVEL <= SLOG_LEVEL_ERROR
+    #define SLOG_ERROR(...) SLOG_INTERNAL_LOG(SLOG_LEVEL_ERROR, __VA_ARGS__)
+    #define SLOG_ERROR_LIMITED(limit, intervalMs, ...) SLOG_INTERNAL_LOG_LIMITED(SLOG_LEVEL_ERROR, limit, intervalMs, __VA_ARGS__)
+    #define SLOG_ERROR_FIELDS(msg, ...) SLOG_INTERNAL_LOG_FIELDS(SLOG_LEVEL_ERROR, msg, __VA_ARGS__)
+#else
+    #define SLOG_ERROR(...) ((void)0)
+    #define SLOG_ERROR_LIMITED(limit, intervalMs, ...) ((void)0)
+    #define SLOG_ERROR_FIELDS(msg, ...) ((void)0)
+#endif
+
+#if SLOG_COMPILE_MIN_LEVEL <= SLOG_LEVEL_FATAL
+    #define SLOG_FATAL(...) SLOG_INTERNAL_LOG(SLOG_LEVEL_FATAL, __VA_ARGS__)
+    #define SLOG_FATAL_LIMITED(limit, intervalMs, ...) SLOG_INTERNAL_LOG_LIMITED(SLOG_LEVEL_FATAL, limit, intervalMs, __VA_ARGS__)
+    #define SLOG_FATAL_FIELDS(msg, ...) SLOG_INTERNAL_LOG_FIELDS(SLOG_LEVEL_FATAL, msg, __VA_ARGS__)
+#else
+    #define SLOG_FATAL(...) ((void)0)
+    #define SLOG_FATAL_LIMITED(limit, intervalMs, ...) ((void)0)
+    #define SLOG_FATAL_FIELDS(msg, ...) ((void)0)
+#endif
+
+#define SLOG_IMPLEMENTATION
+
+#ifdef SLOG_IMPLEMENTATION
+    /*
+     * Define this only if you want to use custom implementations
+     * of malloc, realloc and free.
+     */
+    #ifdef SHRN_NO_USE_STDLIB_H
+        #ifndef SHRN_MALLOC
+            #error `SHRN_MALLOC` must be defined if `SHRN_NO_USE_STDLIB_H` is defined.
+        #endif
+
+        #ifndef SHRN_REALLOC
+            #error `SHRN_REALLOC` must be defined if `SHRN_NO_USE_STDLIB_H` is defined.
+        #endif
+
+        #ifndef SHRN_FREE
+            #error `SHRN_FREE` must be defined if `SHRN_NO_USE_STDLIB_H` is defined.
+        #endif
+    #else
+        #include <stdlib.h>
+
+        #define SHRN_MALLOC(size)           malloc(size)
+        #define SHRN_REALLOC(oldptr, size)  realloc(oldptr, size)
         #define SHRN_FREE(ptr)              free(ptr)
     #endif
 
@@ -184,855 +1090,6972 @@ void SLOGLog(int level, const char * prefix, const char * msg);
                     void * copy = SHRN_MALLOC(size);
                     SHRN_MEMCPY(copy, src, size);
 
-                    while (size--)
-                        ((int8_t *)dst)[size] = ((int8_t *)copy)[size];
+                    while (size--)
+                        ((int8_t *)dst)[size] = ((int8_t *)copy)[size];
+
+                    SHRN_FREE(copy);
+
+                    return dst;
+                }
+            #endif
+
+            #define SHRN_MEMMOVE(dst, src, size) SHRN_InternalMemMove(dst, src, size)
+        #endif
+
+        #ifndef SHRN_MEMSET
+            void * SHRN_InternalMemset(void * ptr, int val, size_t size);
+
+            #ifdef SLOG_IMPLEMENTATION
+                void * SHRN_InternalMemset(void * ptr, int val, size_t size)
+                {
+                    while (size--)
+                        ((int8_t *)ptr)[size] = val;
+
+                    return ptr;
+                }
+            #endif
+
+            #define SHRN_MEMSET(ptr, val, size) SHRN_InternalMemset(ptr, val, size)
+        #endif
+
+        #ifndef SHRN_STRLEN
+            size_t SHRN_InternalStrLen(const char * str);
+
+            #ifdef SLOG_IMPLEMENTATION
+                size_t SHRN_InternalStrLen(const char * str)
+                {
+                    size_t len = 0;
+
+                    while (str[len])
+                        len++;
+
+                    return len;
+                }
+            #endif
+
+            #define SHRN_STRLEN(str) SHRN_InternalStrLen(str)
+        #endif
+
+        #ifndef SHRN_STRNCMP
+            int SHRN_InternalStrNCmp(const char * str0, const char * str1, size_t n);
+
+            #ifdef SLOG_IMPLEMENTATION
+                int SHRN_InternalStrNCmp(const char * str0, const char * str1, size_t n)
+                {
+                    size_t i = 0;
+
+                    size_t len = SHRN_STRLEN(str0);
+
+                    if (SHRN_STRLEN(str1) < len)
+                        len = SHRN_STRLEN(str1);
+
+                    if (n < len)
+                        len = n;
+
+                    for (i = 0; i < len; i++)
+                        if (str0[i] != str1[i])
+                            return str0[i] - str1[i];
+
+                    return 0;
+                }
+            #endif
+
+            #define SHRN_STRNCMP(str0, str1, n) SHRN_InternalStrNCmp(str0, str1, n)
+        #endif
+    #else
+        #include <string.h>
+
+        #define SHRN_MEMCPY(dst, src, size)   memcpy(dst, src, size)
+        #define SHRN_MEMMOVE(dst, src, size)  memmove(dst, src, size)
+        #define SHRN_MEMSET(ptr, val, size)   memset(ptr, val, size)
+        #define SHRN_STRLEN(str)              strlen(str)
+        #define SHRN_STRNCMP(str0, str1, n)   strncmp(str0, str1, n)
+    #endif
+
+    #include <signal.h>
+
+    #ifdef _WIN32
+        #include <windows.h>
+        #include <io.h>
+
+        #define SLOG_INTERNAL_ISATTY(f) _isatty(_fileno(f))
+    #else
+        #include <unistd.h>
+        #include <time.h>
+        #include <errno.h>
+        #include <fcntl.h>
+        #include <sys/mman.h>
+        #include <sys/uio.h>
+        #include <sys/socket.h>
+        #include <sys/un.h>
+        #include <poll.h>
+
+        #if defined(__linux__) && defined(_DEFAULT_SOURCE)
+            #include <sys/syscall.h>
+        #endif
+
+        #define SLOG_INTERNAL_ISATTY(f) isatty(fileno(f))
+    #endif
+
+    /*
+     * Atomic operations on 'size_t' values used to share state between threads.
+     *
+     * The '_INT' variants are relaxed accesses to 'int' settings, the '_PTR'
+     * variants are sequentially consistent operations on pointers.
+     */
+    #if defined(__GNUC__) || defined(__clang__)
+        #define SLOG_INTERNAL_ATOMIC_LOAD(ptr)                   __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+        #define SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(ptr)           __atomic_load_n(ptr, __ATOMIC_RELAXED)
+        #define SLOG_INTERNAL_ATOMIC_STORE(ptr, val)             __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+        #define SLOG_INTERNAL_ATOMIC_FETCH_ADD(ptr, val)         __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST)
+        #define SLOG_INTERNAL_ATOMIC_CAS(ptr, expected, desired) __atomic_compare_exchange_n(ptr, expected, desired, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+        #define SLOG_INTERNAL_ATOMIC_FENCE()                     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+        #define SLOG_INTERNAL_ATOMIC_LOAD_INT(ptr)               __atomic_load_n(ptr, __ATOMIC_RELAXED)
+        #define SLOG_INTERNAL_ATOMIC_STORE_INT(ptr, val)         __atomic_store_n(ptr, val, __ATOMIC_RELAXED)
+
+        #define SLOG_INTERNAL_ATOMIC_LOAD_PTR(ptr)                   __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+        #define SLOG_INTERNAL_ATOMIC_STORE_PTR(ptr, val)             __atomic_store_n(ptr, val, __ATOMIC_SEQ_CST)
+        #define SLOG_INTERNAL_ATOMIC_CAS_PTR(ptr, expected, desired) __atomic_compare_exchange_n(ptr, expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+    #elif defined(_WIN32)
+        #ifdef _WIN64
+            #define SLOG_INTERNAL_INTERLOCKED(name) name##64
+            typedef LONG64 SLOG_InternalAtomicWord;
+        #else
+            #define SLOG_INTERNAL_INTERLOCKED(name) name
+            typedef LONG SLOG_InternalAtomicWord;
+        #endif
+
+        #define SLOG_INTERNAL_ATOMIC_WORD(ptr) ((volatile SLOG_InternalAtomicWord *)(ptr))
+
+        #define SLOG_INTERNAL_ATOMIC_LOAD(ptr)                   ((size_t)SLOG_INTERNAL_INTERLOCKED(InterlockedCompareExchange)(SLOG_INTERNAL_ATOMIC_WORD(ptr), 0, 0))
+        #define SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(ptr)           SLOG_INTERNAL_ATOMIC_LOAD(ptr)
+        #define SLOG_INTERNAL_ATOMIC_STORE(ptr, val)             SLOG_INTERNAL_INTERLOCKED(InterlockedExchange)(SLOG_INTERNAL_ATOMIC_WORD(ptr), (SLOG_InternalAtomicWord)(val))
+        #define SLOG_INTERNAL_ATOMIC_FETCH_ADD(ptr, val)         ((size_t)SLOG_INTERNAL_INTERLOCKED(InterlockedExchangeAdd)(SLOG_INTERNAL_ATOMIC_WORD(ptr), (SLOG_InternalAtomicWord)(val)))
+        #define SLOG_INTERNAL_ATOMIC_CAS(ptr, expected, desired) SLOG_InternalAtomicCas(ptr, expected, desired)
+        #define SLOG_INTERNAL_ATOMIC_FENCE()                     MemoryBarrier()
+
+        #define SLOG_INTERNAL_ATOMIC_LOAD_INT(ptr)               (*(volatile int *)(ptr))
+        #define SLOG_INTERNAL_ATOMIC_STORE_INT(ptr, val)         (*(volatile int *)(ptr) = (val))
+
+        #define SLOG_INTERNAL_ATOMIC_LOAD_PTR(ptr)                   InterlockedCompareExchangePointer((PVOID volatile *)(ptr), NULL, NULL)
+        #define SLOG_INTERNAL_ATOMIC_STORE_PTR(ptr, val)             InterlockedExchangePointer((PVOID volatile *)(ptr), (PVOID)(val))
+        #define SLOG_INTERNAL_ATOMIC_CAS_PTR(ptr, expected, desired) SLOG_InternalAtomicCasPtr((PVOID volatile *)(ptr), (PVOID *)(expected), (PVOID)(desired))
+
+        int SLOG_InternalAtomicCas(size_t * ptr, size_t * expected, size_t desired)
+        {
+            size_t prev = (size_t)SLOG_INTERNAL_INTERLOCKED(InterlockedCompareExchange)(SLOG_INTERNAL_ATOMIC_WORD(ptr),
+                (SLOG_InternalAtomicWord)desired, (SLOG_InternalAtomicWord)*expected);
+
+            if (prev == *expected)
+                return 1;
+
+            *expected = prev;
+
+            return 0;
+        }
+
+        int SLOG_InternalAtomicCasPtr(PVOID volatile * ptr, PVOID * expected, PVOID desired)
+        {
+            PVOID prev = InterlockedCompareExchangePointer(ptr, desired, *expected);
+
+            if (prev == *expected)
+                return 1;
+
+            *expected = prev;
+
+            return 0;
+        }
+    #endif
+
+    /*
+     * Wall clock time in nanoseconds since the Unix epoch.
+     */
+    uint64_t SLOG_InternalNow()
+    {
+    #ifdef _WIN32
+        FILETIME time;
+
+        GetSystemTimeAsFileTime(&time);
+
+        return ((((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime) - 116444736000000000ULL) * 100;
+    #else
+        struct timespec time;
+
+        clock_gettime(CLOCK_REALTIME, &time);
+
+        return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+    #endif
+    }
+
+    /*
+     * Wall clock time in nanoseconds at the resolution of the scheduler tick.
+     */
+    uint64_t SLOG_InternalNowCoarse()
+    {
+    #if !defined(_WIN32) && defined(CLOCK_REALTIME_COARSE)
+        struct timespec time;
+
+        clock_gettime(CLOCK_REALTIME_COARSE, &time);
+
+        return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+    #else
+        return SLOG_InternalNow();
+    #endif
+    }
+
+    /*
+     * Time stamp counter of x86 processors, used by SLOG_CLOCK_TSC.
+     */
+    #if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        #define SLOG_INTERNAL_RDTSC() __builtin_ia32_rdtsc()
+    #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        #include <intrin.h>
+
+        #define SLOG_INTERNAL_RDTSC() __rdtsc()
+    #endif
+
+    /*
+     * Maximum number of digits a 64 bit integer can have in any supported base.
+     */
+    #define SLOG_INTERNAL_MAX_DIGITS 22
+
+    /*
+     * All two digit decimal numbers, used to convert integers two digits at a time.
+     */
+    static const char SLOG_InternalDigitPairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    static const char SLOG_InternalDigitsUpper[] = "0123456789ABCDEF";
+    static const char SLOG_InternalDigitsLower[] = "0123456789abcdef";
+
+    /*
+     * Number of bits needed to represent 'val', 'val' must not be 0.
+     */
+    int SLOG_InternalBitWidth(uint64_t val)
+    {
+    #if defined(__GNUC__) || defined(__clang__)
+        return 64 - __builtin_clzll(val);
+    #else
+        int width = 1;
+
+        if (val >> 32) { width += 32; val >>= 32; }
+        if (val >> 16) { width += 16; val >>= 16; }
+        if (val >> 8)  { width += 8;  val >>= 8; }
+        if (val >> 4)  { width += 4;  val >>= 4; }
+        if (val >> 2)  { width += 2;  val >>= 2; }
+        if (val >> 1)  { width += 1; }
+
+        return width;
+    #endif
+    }
+
+    /*
+     * Number of digits in 'val' when written in 'base'.
+     */
+    int SLOG_InternalCountDigits(uint64_t val, int base)
+    {
+        int count = 1;
+
+        switch (base)
+        {
+            case 8: return (SLOG_InternalBitWidth(val | 1) + 2) / 3;
+            case 16: return (SLOG_InternalBitWidth(val | 1) + 3) / 4;
+        }
+
+        for (;;)
+        {
+            if (val < 10) return count;
+            if (val < 100) return count + 1;
+            if (val < 1000) return count + 2;
+            if (val < 10000) return count + 3;
+
+            val /= 10000;
+            count += 4;
+        }
+    }
+
+    /*
+     * Write the digits of 'val' in 'base' (8, 10 or 16) to 'buf' which must have
+     * room for SLOG_INTERNAL_MAX_DIGITS characters. The result isn't null terminated.
+     *
+     * Returns the number of digits written.
+     */
+    size_t SLOG_InternalToStringU64(char * buf, uint64_t val, int base, int upper)
+    {
+        size_t count = SLOG_InternalCountDigits(val, base);
+
+        char * c = buf + count;
+
+        if (base == 10)
+        {
+            while (val >= 100)
+            {
+                const char * pair = &SLOG_InternalDigitPairs[(val % 100) * 2];
+
+                val /= 100;
+
+                *--c = pair[1];
+                *--c = pair[0];
+            }
+
+            if (val >= 10)
+            {
+                const char * pair = &SLOG_InternalDigitPairs[val * 2];
+
+                *--c = pair[1];
+                *--c = pair[0];
+            }
+            else
+            {
+                *--c = (char)('0' + val);
+            }
+        }
+        else
+        {
+            const char * digits = upper ? SLOG_InternalDigitsUpper : SLOG_InternalDigitsLower;
+
+            int shift = base == 16 ? 4 : 3;
+
+            do
+            {
+                *--c = digits[val & (base - 1)];
+                val >>= shift;
+            } while (val);
+        }
+
+        return count;
+    }
+
+    /*
+     * A floating point number 'F * 2^E' with a 64 bit significand, used by Grisu2.
+     */
+    typedef struct SLOG_InternalDiyFp
+    {
+        uint64_t F;
+        int E;
+    } SLOG_InternalDiyFp;
+
+    /*
+     * Normalized powers of ten 10^-348, 10^-340, ..., 10^340.
+     */
+    static const SLOG_InternalDiyFp SLOG_InternalCachedPowers[] =
+        {
+            { 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 }, { 0x8b16fb203055ac76ULL, -1166 },
+            { 0xcf42894a5dce35eaULL, -1140 }, { 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+            { 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 }, { 0xbe5691ef416bd60cULL, -1007 },
+            { 0x8dd01fad907ffc3cULL, -980 }, { 0xd3515c2831559a83ULL, -954 }, { 0x9d71ac8fada6c9b5ULL, -927 },
+            { 0xea9c227723ee8bcbULL, -901 }, { 0xaecc49914078536dULL, -874 }, { 0x823c12795db6ce57ULL, -847 },
+            { 0xc21094364dfb5637ULL, -821 }, { 0x9096ea6f3848984fULL, -794 }, { 0xd77485cb25823ac7ULL, -768 },
+            { 0xa086cfcd97bf97f4ULL, -741 }, { 0xef340a98172aace5ULL, -715 }, { 0xb23867fb2a35b28eULL, -688 },
+            { 0x84c8d4dfd2c63f3bULL, -661 }, { 0xc5dd44271ad3cdbaULL, -635 }, { 0x936b9fcebb25c996ULL, -608 },
+            { 0xdbac6c247d62a584ULL, -582 }, { 0xa3ab66580d5fdaf6ULL, -555 }, { 0xf3e2f893dec3f126ULL, -529 },
+            { 0xb5b5ada8aaff80b8ULL, -502 }, { 0x87625f056c7c4a8bULL, -475 }, { 0xc9bcff6034c13053ULL, -449 },
+            { 0x964e858c91ba2655ULL, -422 }, { 0xdff9772470297ebdULL, -396 }, { 0xa6dfbd9fb8e5b88fULL, -369 },
+            { 0xf8a95fcf88747d94ULL, -343 }, { 0xb94470938fa89bcfULL, -316 }, { 0x8a08f0f8bf0f156bULL, -289 },
+            { 0xcdb02555653131b6ULL, -263 }, { 0x993fe2c6d07b7facULL, -236 }, { 0xe45c10c42a2b3b06ULL, -210 },
+            { 0xaa242499697392d3ULL, -183 }, { 0xfd87b5f28300ca0eULL, -157 }, { 0xbce5086492111aebULL, -130 },
+            { 0x8cbccc096f5088ccULL, -103 }, { 0xd1b71758e219652cULL, -77 }, { 0x9c40000000000000ULL, -50 },
+            { 0xe8d4a51000000000ULL, -24 }, { 0xad78ebc5ac620000ULL, 3 }, { 0x813f3978f8940984ULL, 30 },
+            { 0xc097ce7bc90715b3ULL, 56 }, { 0x8f7e32ce7bea5c70ULL, 83 }, { 0xd5d238a4abe98068ULL, 109 },
+            { 0x9f4f2726179a2245ULL, 136 }, { 0xed63a231d4c4fb27ULL, 162 }, { 0xb0de65388cc8ada8ULL, 189 },
+            { 0x83c7088e1aab65dbULL, 216 }, { 0xc45d1df942711d9aULL, 242 }, { 0x924d692ca61be758ULL, 269 },
+            { 0xda01ee641a708deaULL, 295 }, { 0xa26da3999aef774aULL, 322 }, { 0xf209787bb47d6b85ULL, 348 },
+            { 0xb454e4a179dd1877ULL, 375 }, { 0x865b86925b9bc5c2ULL, 402 }, { 0xc83553c5c8965d3dULL, 428 },
+            { 0x952ab45cfa97a0b3ULL, 455 }, { 0xde469fbd99a05fe3ULL, 481 }, { 0xa59bc234db398c25ULL, 508 },
+            { 0xf6c69a72a3989f5cULL, 534 }, { 0xb7dcbf5354e9beceULL, 561 }, { 0x88fcf317f22241e2ULL, 588 },
+            { 0xcc20ce9bd35c78a5ULL, 614 }, { 0x98165af37b2153dfULL, 641 }, { 0xe2a0b5dc971f303aULL, 667 },
+            { 0xa8d9d1535ce3b396ULL, 694 }, { 0xfb9b7cd9a4a7443cULL, 720 }, { 0xbb764c4ca7a44410ULL, 747 },
+            { 0x8bab8eefb6409c1aULL, 774 }, { 0xd01fef10a657842cULL, 800 }, { 0x9b10a4e5e9913129ULL, 827 },
+            { 0xe7109bfba19c0c9dULL, 853 }, { 0xac2820d9623bf429ULL, 880 }, { 0x80444b5e7aa7cf85ULL, 907 },
+            { 0xbf21e44003acdd2dULL, 933 }, { 0x8e679c2f5e44ff8fULL, 960 }, { 0xd433179d9c8cb841ULL, 986 },
+            { 0x9e19db92b4e31ba9ULL, 1013 }, { 0xeb96bf6ebadf77d9ULL, 1039 }, { 0xaf87023b9bf0ee6bULL, 1066 }
+        };
+
+    static const uint64_t SLOG_InternalPowersOf10[] =
+        {
+            1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+            100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+            10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+            100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+        };
+
+    /*
+     * Split a finite, positive 'value' into 'F * 2^E' with the hidden bit set for normal numbers.
+     */
+    SLOG_InternalDiyFp SLOG_InternalDiyFpFromDouble(double value)
+    {
+        SLOG_InternalDiyFp res;
+
+        uint64_t bits;
+        int exponent;
+
+        SHRN_MEMCPY(&bits, &value, sizeof(bits));
+
+        exponent = (int)((bits >> 52) & 0x7FF);
+
+        res.F = bits & 0x000FFFFFFFFFFFFFULL;
+
+        if (exponent)
+        {
+            res.F += 0x0010000000000000ULL;
+            res.E = exponent - 1075;
+        }
+        else
+        {
+            res.E = -1074;
+        }
+
+        return res;
+    }
+
+    SLOG_InternalDiyFp SLOG_InternalDiyFpMultiply(SLOG_InternalDiyFp x, SLOG_InternalDiyFp y)
+    {
+        const uint64_t mask = 0xFFFFFFFFULL;
+
+        uint64_t a = x.F >> 32, b = x.F & mask;
+        uint64_t c = y.F >> 32, d = y.F & mask;
+
+        uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+
+        /*
+         * The '1 << 31' rounds the discarded lower half.
+         */
+        uint64_t tmp = (bd >> 32) + (ad & mask) + (bc & mask) + (1ULL << 31);
+
+        SLOG_InternalDiyFp res;
+
+        res.F = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+        res.E = x.E + y.E + 64;
+
+        return res;
+    }
+
+    void SLOG_InternalGrisuRound(char * digits, int length, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t distance)
+    {
+        while (rest < distance && delta - rest >= tenKappa
+            && (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance))
+        {
+            digits[length - 1]--;
+            rest += tenKappa;
+        }
+    }
+
+    /*
+     * Write the shortest digits that round trip to a finite, positive 'value'
+     * using Florian Loitsch's Grisu2, so that 'value == digits * 10^K'.
+     *
+     * 'digits' must have room for 20 characters. Returns the number of digits.
+     */
+    int SLOG_InternalGrisu2(double value, char * digits, int * K)
+    {
+        SLOG_InternalDiyFp v = SLOG_InternalDiyFpFromDouble(value);
+        SLOG_InternalDiyFp plus, minus, cached, w, one;
+
+        uint64_t delta, distance, rest;
+        uint32_t integral;
+
+        int shift, kappa, index, length = 0;
+
+        double dk;
+
+        /*
+         * Boundaries of the rounding interval of 'value', 'plus' normalized.
+         */
+        plus.F = (v.F << 1) + 1;
+        plus.E = v.E - 1;
+
+        shift = 64 - SLOG_InternalBitWidth(plus.F);
+        plus.F <<= shift;
+        plus.E -= shift;
+
+        if (v.F == 0x0010000000000000ULL)
+        {
+            minus.F = (v.F << 2) - 1;
+            minus.E = v.E - 2;
+        }
+        else
+        {
+            minus.F = (v.F << 1) - 1;
+            minus.E = v.E - 1;
+        }
+
+        minus.F <<= minus.E - plus.E;
+        minus.E = plus.E;
+
+        shift = 64 - SLOG_InternalBitWidth(v.F);
+        v.F <<= shift;
+        v.E -= shift;
+
+        /*
+         * Pick the cached power which brings the exponent of 'plus' to [-60, -32].
+         */
+        dk = (-61 - plus.E) * 0.30102999566398114 + 347;
+        index = (int)dk;
+
+        if (dk - index > 0.0)
+            index++;
+
+        index = (index >> 3) + 1;
+        *K = 348 - (index << 3);
+
+        cached = SLOG_InternalCachedPowers[index];
+
+        w = SLOG_InternalDiyFpMultiply(v, cached);
+        plus = SLOG_InternalDiyFpMultiply(plus, cached);
+        minus = SLOG_InternalDiyFpMultiply(minus, cached);
+
+        minus.F++;
+        plus.F--;
+
+        delta = plus.F - minus.F;
+        distance = plus.F - w.F;
+
+        one.F = 1ULL << -plus.E;
+        one.E = plus.E;
+
+        integral = (uint32_t)(plus.F >> -one.E);
+        rest = plus.F & (one.F - 1);
+
+        /*
+         * Generate digits of the integral part.
+         */
+        for (kappa = SLOG_InternalCountDigits(integral, 10); kappa > 0;)
+        {
+            uint32_t d = integral / (uint32_t)SLOG_InternalPowersOf10[kappa - 1];
+
+            integral %= (uint32_t)SLOG_InternalPowersOf10[kappa - 1];
+
+            if (d || length)
+                digits[length++] = (char)('0' + d);
+
+            kappa--;
+
+            if ((((uint64_t)integral << -one.E) + rest) <= delta)
+            {
+                *K += kappa;
+
+                SLOG_InternalGrisuRound(digits, length, delta, ((uint64_t)integral << -one.E) + rest,
+                    SLOG_InternalPowersOf10[kappa] << -one.E, distance);
+
+                return length;
+            }
+        }
+
+        /*
+         * Generate digits of the fractional part.
+         */
+        for (;;)
+        {
+            char d;
+
+            rest *= 10;
+            delta *= 10;
+
+            d = (char)(rest >> -one.E);
+
+            if (d || length)
+                digits[length++] = (char)('0' + d);
+
+            rest &= one.F - 1;
+            kappa--;
+
+            if (rest < delta)
+            {
+                *K += kappa;
+
+                SLOG_InternalGrisuRound(digits, length, delta, rest, one.F,
+                    -kappa < 20 ? distance * SLOG_InternalPowersOf10[-kappa] : 0);
+
+                return length;
+            }
+        }
+    }
+
+    /*
+     * Big enough for '2^53 * 5^1074', the largest number SLOG_InternalExactDigits works with.
+     */
+    #define SLOG_INTERNAL_BIGNUM_LIMBS 84
+
+    /*
+     * Big enough for all the digits of '2^53 * 5^1074'.
+     */
+    #define SLOG_INTERNAL_MAX_EXACT_DIGITS 800
+
+    typedef struct SLOG_InternalBigNum
+    {
+        uint32_t Limbs[SLOG_INTERNAL_BIGNUM_LIMBS];
+        int Size;
+    } SLOG_InternalBigNum;
+
+    void SLOG_InternalBigNumMultiply(SLOG_InternalBigNum * num, uint32_t factor)
+    {
+        uint64_t carry = 0;
+
+        int i = 0;
+
+        for (i = 0; i < num->Size; i++)
+        {
+            carry += (uint64_t)num->Limbs[i] * factor;
+            num->Limbs[i] = (uint32_t)carry;
+            carry >>= 32;
+        }
+
+        if (carry)
+            num->Limbs[num->Size++] = (uint32_t)carry;
+    }
+
+    void SLOG_InternalBigNumShiftLeft(SLOG_InternalBigNum * num, int shift)
+    {
+        int limbs = shift / 32;
+        int bits = shift % 32;
+
+        int i = 0;
+
+        if (bits)
+        {
+            uint32_t carry = 0;
+
+            for (i = 0; i < num->Size; i++)
+            {
+                uint32_t limb = num->Limbs[i];
+
+                num->Limbs[i] = (limb << bits) | carry;
+                carry = limb >> (32 - bits);
+            }
+
+            if (carry)
+                num->Limbs[num->Size++] = carry;
+        }
+
+        if (limbs)
+        {
+            SHRN_MEMMOVE(num->Limbs + limbs, num->Limbs, num->Size * sizeof(uint32_t));
+            SHRN_MEMSET(num->Limbs, 0, limbs * sizeof(uint32_t));
+
+            num->Size += limbs;
+        }
+    }
+
+    /*
+     * Divide 'num' by 'divisor' in place and return the remainder.
+     */
+    uint32_t SLOG_InternalBigNumDivide(SLOG_InternalBigNum * num, uint32_t divisor)
+    {
+        uint64_t rem = 0;
+
+        int i = 0;
+
+        for (i = num->Size - 1; i >= 0; i--)
+        {
+            rem = (rem << 32) | num->Limbs[i];
+            num->Limbs[i] = (uint32_t)(rem / divisor);
+            rem %= divisor;
+        }
+
+        while (num->Size && !num->Limbs[num->Size - 1])
+            num->Size--;
+
+        return (uint32_t)rem;
+    }
+
+    /*
+     * Write every digit of the exact decimal expansion of a finite, positive 'value'
+     * without trailing zeros. 'point' receives the position of the decimal point
+     * relative to the first digit.
+     *
+     * 'digits' must have room for SLOG_INTERNAL_MAX_EXACT_DIGITS characters.
+     * Returns the number of digits.
+     */
+    int SLOG_InternalExactDigits(double value, char * digits, int * point)
+    {
+        SLOG_InternalDiyFp v = SLOG_InternalDiyFpFromDouble(value);
+        SLOG_InternalBigNum num;
+
+        char * c = digits + SLOG_INTERNAL_MAX_EXACT_DIGITS;
+
+        int length = 0;
+
+        num.Limbs[0] = (uint32_t)v.F;
+        num.Limbs[1] = (uint32_t)(v.F >> 32);
+        num.Size = num.Limbs[1] ? 2 : 1;
+
+        /*
+         * 'F * 2^E' is an integer for positive 'E', for negative 'E' it is
+         * 'F * 5^-E' with the decimal point moved '-E' digits to the left.
+         */
+        if (v.E >= 0)
+        {
+            SLOG_InternalBigNumShiftLeft(&num, v.E);
+        }
+        else
+        {
+            int exp5 = -v.E;
+
+            for (; exp5 >= 13; exp5 -= 13)
+                SLOG_InternalBigNumMultiply(&num, 1220703125u);
+
+            SLOG_InternalBigNumMultiply(&num, (uint32_t)(SLOG_InternalPowersOf10[exp5] >> exp5));
+        }
+
+        while (num.Size)
+        {
+            uint32_t chunk = SLOG_InternalBigNumDivide(&num, 1000000000u);
+
+            int i = 0;
+
+            for (i = 0; i < 9; i++, chunk /= 10)
+                *--c = (char)('0' + chunk % 10);
+        }
+
+        while (*c == '0')
+            c++;
+
+        length = (int)(digits + SLOG_INTERNAL_MAX_EXACT_DIGITS - c);
+
+        *point = length + (v.E < 0 ? v.E : 0);
+
+        SHRN_MEMMOVE(digits, c, length);
+
+        while (digits[length - 1] == '0')
+            length--;
+
+        return length;
+    }
+
+    /*
+     * Round 'digits' to its first 'keep' digits, ties are rounded half to even
+     * when 'digits' is exact and up otherwise. 'point' is adjusted when rounding
+     * carries into a new digit.
+     *
+     * Returns the number of digits left, trailing zeros are removed.
+     */
+    int SLOG_InternalRoundDigits(char * digits, int length, int * point, int keep, int exact)
+    {
+        int up = 0;
+
+        if (keep < length)
+        {
+            if (keep < 0)
+                return 0;
+
+            up = digits[keep] >= '5';
+
+            if (exact && digits[keep] == '5' && length == keep + 1)
+                up = keep > 0 && (digits[keep - 1] - '0') % 2;
+
+            length = keep;
+
+            if (up)
+            {
+                while (length > 0 && digits[length - 1] == '9')
+                    length--;
+
+                if (length == 0)
+                {
+                    digits[length++] = '1';
+                    (*point)++;
+                }
+                else
+                {
+                    digits[length - 1]++;
+                }
+            }
+        }
+
+        while (length > 0 && digits[length - 1] == '0')
+            length--;
+
+        return length;
+    }
+
+    #ifndef NDEBUG
+        #include <assert.h>
+
+        #define SLOG_INTERNAL_DEBUG_ASSERT(cond) assert(cond)
+    #else
+        #define SLOG_INTERNAL_DEBUG_ASSERT(cond) ((void)0)
+    #endif
+
+    static int SLOGPreallocate = 0;
+    static size_t SLOGAllocations = 0;
+    static size_t SLOGAllocatedBytes = 0;
+    static size_t SLOGPreallocatedBytes = 0;
+
+    /*
+     * Allocate 'size' bytes for a log, counted by SLOGGetStats.
+     */
+    void * SLOG_InternalLogAlloc(size_t size)
+    {
+        SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGAllocations, 1);
+        SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGAllocatedBytes, size);
+
+        SLOG_INTERNAL_DEBUG_ASSERT(!SLOGPreallocate && "a log allocated with SLOGConfig::Preallocate");
+
+        return SHRN_MALLOC(size);
+    }
+
+    /*
+     * Memory for compiled formats and call sites kept with SLOGConfig::Preallocate,
+     * taken front to back and never given back.
+     */
+    static char * SLOGSiteMemory = NULL;
+    static size_t SLOGSiteMemorySize = 0;
+    static size_t SLOGSiteMemoryUsed = 0;
+
+    #define SLOG_INTERNAL_IS_SITE_MEMORY(ptr)\
+        ((char *)(ptr) >= SLOGSiteMemory && (char *)(ptr) < SLOGSiteMemory + SLOGSiteMemorySize)
+
+    /*
+     * Allocate 'size' bytes aligned to 16 that live as long as the program,
+     * for a call site or its compiled format.
+     */
+    void * SLOG_InternalSiteAlloc(size_t size)
+    {
+        size_t used = SLOG_INTERNAL_ATOMIC_LOAD(&SLOGSiteMemoryUsed);
+
+        size = (size + 15) & ~(size_t)15;
+
+        while (size <= SLOGSiteMemorySize - used)
+        {
+            if (SLOG_INTERNAL_ATOMIC_CAS(&SLOGSiteMemoryUsed, &used, used + size))
+                return SLOGSiteMemory + used;
+        }
+
+        return SLOG_InternalLogAlloc(size);
+    }
+
+    /*
+     * Free memory returned by SLOG_InternalSiteAlloc.
+     */
+    void SLOG_InternalSiteFree(void * ptr)
+    {
+        if (!SLOG_INTERNAL_IS_SITE_MEMORY(ptr))
+            SHRN_FREE(ptr);
+    }
+
+    /*
+     * Temporary that didn't fit into the arena of a thread, allocated with
+     * its header and freed when the log is written.
+     */
+    typedef union SLOG_InternalOversize
+    {
+        union SLOG_InternalOversize * Next;
+        double Align[2];
+    } SLOG_InternalOversize;
+
+    /*
+     * State every logging thread keeps for itself, created on its first log
+     * and freed when the thread exits.
+     */
+    typedef struct SLOG_InternalThreadState
+    {
+        char * Arena;           /* Built-in arena for the temporaries of logs, see SLOG_InternalArenaAlloc. */
+        size_t ArenaSize;
+        size_t ArenaUsed;
+        char * ArenaLast;       /* The last allocation in 'Arena', which can grow in place. */
+        SLOGArena Custom;       /* Set by SLOGSetThreadArena, used instead of 'Arena' when 'Custom.Alloc' is set. */
+        SLOG_InternalOversize * Oversize; /* Temporaries the arena couldn't hold. */
+        int Depth;              /* Logs the thread is writing, a sink can log itself. */
+        int Pooled;             /* Taken from SLOGStatePool, goes back there when the thread exits. */
+        struct SLOG_InternalThreadState * Next; /* The next unused state in SLOGStatePool. */
+        uint64_t LastTime;      /* Time of the last log, times never go back. */
+        uint64_t AnchorTsc;     /* Time stamp counter read with 'AnchorTime' by SLOG_CLOCK_TSC. */
+        uint64_t AnchorTime;
+        uint64_t Second;        /* The second 'SecondText' holds. */
+        char SecondText[20];    /* 'YYYY-MM-DDTHH:MM:SS' of the last rendered timestamp. */
+    } SLOG_InternalThreadState;
+
+    #if defined(SLOG_NO_THREADS)
+        #define SLOG_INTERNAL_THREAD_LOCAL
+    #elif defined(_MSC_VER)
+        #define SLOG_INTERNAL_THREAD_LOCAL __declspec(thread)
+    #else
+        #define SLOG_INTERNAL_THREAD_LOCAL __thread
+    #endif
+
+    static SLOG_INTERNAL_THREAD_LOCAL SLOG_InternalThreadState * SLOGThreadState = NULL;
+
+    static size_t SLOGArenaSize = 16384;
+
+    /*
+     * Take 'size' bytes aligned to 16 for a temporary of the log 'state' is
+     * writing, from the arena of the thread or, when it's full, the heap.
+     */
+    void * SLOG_InternalArenaAlloc(SLOG_InternalThreadState * state, size_t size)
+    {
+        SLOG_InternalOversize * oversize;
+
+        size = (size + 15) & ~(size_t)15;
+
+        if (state->Custom.Alloc)
+        {
+            void * data = state->Custom.Alloc(state->Custom.User, size);
+
+            if (data)
+                return data;
+        }
+        else
+        {
+            if (!state->Arena && SLOGArenaSize)
+            {
+                state->Arena = (char *)SLOG_InternalLogAlloc(SLOGArenaSize);
+                state->ArenaSize = state->Arena ? SLOGArenaSize : 0;
+            }
+
+            if (size <= state->ArenaSize - state->ArenaUsed)
+            {
+                state->ArenaLast = state->Arena + state->ArenaUsed;
+                state->ArenaUsed += size;
+
+                return state->ArenaLast;
+            }
+        }
+
+        oversize = (SLOG_InternalOversize *)SLOG_InternalLogAlloc(sizeof(SLOG_InternalOversize) + size);
+
+        if (!oversize)
+            return NULL;
+
+        oversize->Next = state->Oversize;
+        state->Oversize = oversize;
+
+        return oversize + 1;
+    }
+
+    /*
+     * Give 'data', a temporary holding 'size' bytes, room for at least 'need'
+     * and up to '*capacity' bytes, and store the room it got in '*capacity'.
+     * The last temporary in the built-in arena grows in place, others are
+     * copied.
+     */
+    char * SLOG_InternalArenaGrow(SLOG_InternalThreadState * state, char * data, size_t size, size_t need, size_t * capacity)
+    {
+        char * grown;
+
+        if (data && data == state->ArenaLast && need <= state->ArenaSize - (size_t)(data - state->Arena))
+        {
+            size_t room = state->ArenaSize - (size_t)(data - state->Arena);
+
+            if (*capacity > room)
+                *capacity = room;
+
+            state->ArenaUsed = (size_t)(data - state->Arena) + ((*capacity + 15) & ~(size_t)15);
+
+            if (state->ArenaUsed > state->ArenaSize)
+                state->ArenaUsed = state->ArenaSize;
+
+            return data;
+        }
+
+        grown = (char *)SLOG_InternalArenaAlloc(state, *capacity);
+
+        if (grown && size)
+            SHRN_MEMCPY(grown, data, size);
+
+        return grown;
+    }
+
+    /*
+     * Output buffer of the format engine.
+     *
+     * A growable buffer's 'Data' is a SUTLString whose size is used as the
+     * capacity of the buffer. The capacity grows geometrically so appending
+     * is amortized O(1). With SLOG_INTERNAL_GROW_ARENA the buffer grows the
+     * same way in the arena of the calling thread, which has to be writing a
+     * log, see SLOG_InternalArenaBuffer.
+     *
+     * A fixed buffer's 'Data' is provided by the caller and is never resized,
+     * output that doesn't fit is dropped. In both cases 'Size' is the number
+     * of bytes the output needs, which can be more than 'Capacity' for fixed
+     * buffers.
+     *
+     * 'Color' selects whether escape sequences are written.
+     */
+    typedef struct SLOG_InternalBuffer
+    {
+        char * Data;
+        size_t Size;
+        size_t Capacity;
+        int Growable;
+        int Color;
+    } SLOG_InternalBuffer;
+
+    #define SLOG_INTERNAL_GROW_ARENA 2
+
+    /*
+     * Make room for 'size' more bytes and return how many of them can be written.
+     */
+    size_t SLOG_InternalBufferReserve(SLOG_InternalBuffer * buf, size_t size)
+    {
+        if (buf->Size + size > buf->Capacity)
+        {
+            if (!buf->Growable)
+            {
+                return buf->Size < buf->Capacity ? buf->Capacity - buf->Size : 0;
+            }
+            else
+            {
+                size_t capacity = buf->Capacity * 2;
+
+                if (capacity < buf->Size + size)
+                    capacity = buf->Size + size;
+
+                if (buf->Growable == SLOG_INTERNAL_GROW_ARENA)
+                {
+                    char * data = SLOG_InternalArenaGrow(SLOGThreadState, buf->Data, buf->Size < buf->Capacity ? buf->Size : buf->Capacity, buf->Size + size, &capacity);
+
+                    /*
+                     * Out of memory, keep what fits like a fixed buffer.
+                     */
+                    if (!data)
+                    {
+                        buf->Growable = 0;
+
+                        return buf->Size < buf->Capacity ? buf->Capacity - buf->Size : 0;
+                    }
+
+                    buf->Data = data;
+                }
+                else
+                {
+                    SUTLStringResize(buf->Data, capacity);
+                }
+
+                buf->Capacity = capacity;
+            }
+        }
+
+        return size;
+    }
+
+    /*
+     * Make 'buf' an empty growable buffer in the arena of 'state', with room for 'capacity' bytes.
+     */
+    SLOG_InternalBuffer * SLOG_InternalArenaBuffer(SLOG_InternalThreadState * state, SLOG_InternalBuffer * buf, int color, size_t capacity)
+    {
+        buf->Data = capacity ? (char *)SLOG_InternalArenaAlloc(state, capacity) : NULL;
+        buf->Size = 0;
+        buf->Capacity = buf->Data ? capacity : 0;
+        buf->Growable = SLOG_INTERNAL_GROW_ARENA;
+        buf->Color = color;
+
+        return buf;
+    }
+
+    void SLOG_InternalBufferAppend(SLOG_InternalBuffer * buf, const char * data, size_t size)
+    {
+        size_t writable = SLOG_InternalBufferReserve(buf, size);
+
+        if (writable)
+            SHRN_MEMCPY(buf->Data + buf->Size, data, writable);
+
+        buf->Size += size;
+    }
+
+    void SLOG_InternalBufferAppendFill(SLOG_InternalBuffer * buf, char c, size_t count)
+    {
+        size_t writable = SLOG_InternalBufferReserve(buf, count);
+
+        if (writable)
+            SHRN_MEMSET(buf->Data + buf->Size, c, writable);
+
+        buf->Size += count;
+    }
+
+    void SLOG_InternalBufferAppendC(SLOG_InternalBuffer * buf, char c)
+    {
+        if (buf->Size < buf->Capacity)
+            buf->Data[buf->Size++] = c;
+        else
+            SLOG_InternalBufferAppend(buf, &c, 1);
+    }
+
+    void SLOG_InternalBufferAppendP(SLOG_InternalBuffer * buf, const char * str)
+    {
+        SLOG_InternalBufferAppend(buf, str, SHRN_STRLEN(str));
+    }
+
+    /*
+     * Append an integer given by its sign and magnitude, zero padded to 'width'
+     * characters including the sign. A 'width' of -1 disables padding.
+     */
+    void SLOG_InternalBufferAppendInt(SLOG_InternalBuffer * buf, uint64_t magnitude, int negative, int base, int width, int upper)
+    {
+        char digits[SLOG_INTERNAL_MAX_DIGITS];
+
+        size_t count = SLOG_InternalToStringU64(digits, magnitude, base, upper);
+
+        if (negative)
+            SLOG_InternalBufferAppendC(buf, '-');
+
+        if (width > 0 && (size_t)width > count + negative)
+            SLOG_InternalBufferAppendFill(buf, '0', width - count - negative);
+
+        SLOG_InternalBufferAppend(buf, digits, count);
+    }
+
+    /*
+     * Append 'digits' in fixed notation with 'fraction' digits after the point.
+     * Positions not covered by 'digits' are written as zeros.
+     */
+    void SLOG_InternalBufferAppendFixed(SLOG_InternalBuffer * buf, const char * digits, int length, int point, int fraction)
+    {
+        if (point <= 0)
+        {
+            SLOG_InternalBufferAppendC(buf, '0');
+        }
+        else
+        {
+            SLOG_InternalBufferAppend(buf, digits, point < length ? point : length);
+
+            if (point > length)
+                SLOG_InternalBufferAppendFill(buf, '0', point - length);
+        }
+
+        if (fraction > 0)
+        {
+            int start = point;
+            int count = 0;
+
+            SLOG_InternalBufferAppendC(buf, '.');
+
+            if (start < 0)
+            {
+                count = -start < fraction ? -start : fraction;
+
+                SLOG_InternalBufferAppendFill(buf, '0', count);
+
+                fraction -= count;
+                start = 0;
+            }
+
+            count = length - start;
+
+            if (count > fraction)
+                count = fraction;
+
+            if (count > 0)
+            {
+                SLOG_InternalBufferAppend(buf, digits + start, count);
+                fraction -= count;
+            }
+
+            SLOG_InternalBufferAppendFill(buf, '0', fraction);
+        }
+    }
+
+    /*
+     * Append 'digits' in scientific notation with 'fraction' digits after the point.
+     */
+    void SLOG_InternalBufferAppendExponent(SLOG_InternalBuffer * buf, const char * digits, int length, int point, int fraction)
+    {
+        int exponent = length ? point - 1 : 0;
+
+        SLOG_InternalBufferAppendC(buf, length ? digits[0] : '0');
+
+        if (fraction > 0)
+        {
+            int count = length - 1 < fraction ? length - 1 : fraction;
+
+            SLOG_InternalBufferAppendC(buf, '.');
+
+            if (count > 0)
+                SLOG_InternalBufferAppend(buf, digits + 1, count);
+
+            SLOG_InternalBufferAppendFill(buf, '0', fraction - (count > 0 ? count : 0));
+        }
+
+        SLOG_InternalBufferAppendC(buf, 'e');
+        SLOG_InternalBufferAppendC(buf, exponent < 0 ? '-' : '+');
+
+        /*
+         * The exponent has at least two digits like in printf.
+         */
+        SLOG_InternalBufferAppendInt(buf, exponent < 0 ? -exponent : exponent, 0, 10, 2, 1);
+    }
+
+    /*
+     * Append 'digits', already rounded to 'precision', as a 'f', 'e' or 'g' conversion.
+     */
+    void SLOG_InternalBufferAppendDigits(SLOG_InternalBuffer * buf, const char * digits, int length, int point, char conversion, int precision)
+    {
+        switch (conversion)
+        {
+            case 'e':
+            {
+                SLOG_InternalBufferAppendExponent(buf, digits, length, point, precision);
+
+                break;
+            }
+
+            case 'g':
+            {
+                int exponent = length ? point - 1 : 0;
+
+                /*
+                 * Like in printf, trailing zeros are dropped.
+                 */
+                if (exponent >= -4 && exponent < precision)
+                    SLOG_InternalBufferAppendFixed(buf, digits, length, point, length - point);
+                else
+                    SLOG_InternalBufferAppendExponent(buf, digits, length, point, length - 1);
+
+                break;
+            }
+
+            default:
+            {
+                SLOG_InternalBufferAppendFixed(buf, digits, length, point, precision);
+
+                break;
+            }
+        }
+    }
+
+    /*
+     * Append 'd' as a 'f', 'e' or 'g' conversion.
+     *
+     * Without a precision the shortest digits that round trip are used,
+     * otherwise 'd' is rounded to 'precision' digits like in printf.
+     */
+    void SLOG_InternalBufferAppendDouble(SLOG_InternalBuffer * buf, double d, char conversion, int precision)
+    {
+        char digits[20];
+
+        int length = 0;
+        int point = 1;
+        int keep = 0;
+        int exact = 0;
+
+        uint64_t bits;
+
+        SHRN_MEMCPY(&bits, &d, sizeof(bits));
+
+        if (bits >> 63)
+        {
+            SLOG_InternalBufferAppendC(buf, '-');
+            d = -d;
+        }
+
+        if (((bits >> 52) & 0x7FF) == 0x7FF)
+        {
+            SLOG_InternalBufferAppendP(buf, bits & 0x000FFFFFFFFFFFFFULL ? "nan" : "inf");
+            return;
+        }
+
+        if (d != 0.0)
+        {
+            length = SLOG_InternalGrisu2(d, digits, &point);
+            point += length;
+            length = SLOG_InternalRoundDigits(digits, length, &point, length, 0);
+        }
+
+        if (precision < 0)
+        {
+            int exponent = length ? point - 1 : 0;
+
+            if (conversion == 'e' || (conversion == 'g' && (exponent < -4 || exponent >= 17)))
+                SLOG_InternalBufferAppendExponent(buf, digits, length, point, length - 1);
+            else
+                SLOG_InternalBufferAppendFixed(buf, digits, length, point, length - point);
+
+            return;
+        }
+
+        if (conversion == 'g' && precision == 0)
+            precision = 1;
+
+        switch (conversion)
+        {
+            case 'e': keep = precision + 1; break;
+            case 'g': keep = precision; break;
+            default: keep = point + precision; break;
+        }
+
+        /*
+         * The shortest digits are within one ulp of the exact value, so rounding
+         * them gives the same result as rounding the exact value as long as the
+         * rounding position is well within double precision and the digits after
+         * it aren't close to a tie. Otherwise fall back to the exact digits.
+         */
+        if (length && keep >= 0)
+        {
+            int i = 0;
+            int next = 0;
+
+            for (i = keep; i < keep + 3; i++)
+                next = next * 10 + (i < length ? digits[i] - '0' : 0);
+
+            exact = keep > 14 || (next >= 450 && next <= 550);
+        }
+
+        if (exact)
+        {
+            char exactDigits[SLOG_INTERNAL_MAX_EXACT_DIGITS];
+
+            length = SLOG_InternalExactDigits(d, exactDigits, &point);
+
+            if (conversion == 'f')
+                keep = point + precision;
+
+            length = SLOG_InternalRoundDigits(exactDigits, length, &point, keep, 1);
+
+            SLOG_InternalBufferAppendDigits(buf, exactDigits, length, point, conversion, precision);
+        }
+        else
+        {
+            length = SLOG_InternalRoundDigits(digits, length, &point, keep, 0);
+
+            SLOG_InternalBufferAppendDigits(buf, digits, length, point, conversion, precision);
+        }
+    }
+
+    /*
+     * Whether escape sequences are written, see SLOGSetColorMode.
+     */
+    static int SLOGColorEnabled = 1;
+
+    typedef struct SLOG_InternalEscape
+    {
+        const char * Text;
+        size_t Size;
+    } SLOG_InternalEscape;
+
+    #define SLOG_INTERNAL_ESCAPE(text) { text, sizeof(text) - 1 }
+
+    #define SLOG_INTERNAL_COLOR_ESCAPES(code)\
+        {\
+            SLOG_INTERNAL_ESCAPE("\033[0;" code "m"),\
+            SLOG_INTERNAL_ESCAPE("\033[0;" code ";1m"),\
+            SLOG_INTERNAL_ESCAPE("\033[0;" code ";3m"),\
+            SLOG_INTERNAL_ESCAPE("\033[0;" code ";1;3m")\
+        }
+
+    /*
+     * Escape sequences of '%=' sequences indexed by color and style.
+     *
+     * Colors are 'def' (or any unknown name), 'red', 'grn', 'ylw', 'blu',
+     * 'pnk', 'cyn' and 'wht'. The style index has bit 0 set for bold ('b'
+     * as 4th character) and bit 1 set for italic ('i' as 5th character).
+     */
+    static const SLOG_InternalEscape SLOG_InternalColorEscapes[8][4] =
+        {
+            SLOG_INTERNAL_COLOR_ESCAPES("0"),
+            SLOG_INTERNAL_COLOR_ESCAPES("31"),
+            SLOG_INTERNAL_COLOR_ESCAPES("32"),
+            SLOG_INTERNAL_COLOR_ESCAPES("33"),
+            SLOG_INTERNAL_COLOR_ESCAPES("34"),
+            SLOG_INTERNAL_COLOR_ESCAPES("35"),
+            SLOG_INTERNAL_COLOR_ESCAPES("36"),
+            SLOG_INTERNAL_COLOR_ESCAPES("37")
+        };
+
+    #undef SLOG_INTERNAL_COLOR_ESCAPES
+    #undef SLOG_INTERNAL_ESCAPE
+
+    /*
+     * Look up the escape of the 3 color and 2 style characters at 'color'.
+     */
+    const SLOG_InternalEscape * SLOG_InternalColorEscape(const char * color)
+    {
+        int index = 0;
+
+        switch (color[0])
+        {
+            case 'r': index = color[1] == 'e' && color[2] == 'd' ? 1 : 0; break;
+            case 'g': index = color[1] == 'r' && color[2] == 'n' ? 2 : 0; break;
+            case 'y': index = color[1] == 'l' && color[2] == 'w' ? 3 : 0; break;
+            case 'b': index = color[1] == 'l' && color[2] == 'u' ? 4 : 0; break;
+            case 'p': index = color[1] == 'n' && color[2] == 'k' ? 5 : 0; break;
+            case 'c': index = color[1] == 'y' && color[2] == 'n' ? 6 : 0; break;
+            case 'w': index = color[1] == 'h' && color[2] == 't' ? 7 : 0; break;
+        }
+
+        return &SLOG_InternalColorEscapes[index][(color[3] == 'b') | (color[4] == 'i') << 1];
+    }
+
+    /*
+     * Kinds of '%' sequences.
+     */
+    enum
+    {
+        SLOG_INTERNAL_SPEC_LITERAL, /* Text copied as it is, also used for unknown sequences. */
+        SLOG_INTERNAL_SPEC_ESCAPE,  /* Color sequence, 'Text' points to its pre-rendered escape. */
+        SLOG_INTERNAL_SPEC_BOOL,
+        SLOG_INTERNAL_SPEC_CHAR,
+        SLOG_INTERNAL_SPEC_INT,
+        SLOG_INTERNAL_SPEC_UINT,
+        SLOG_INTERNAL_SPEC_DOUBLE,
+        SLOG_INTERNAL_SPEC_POINTER,
+        SLOG_INTERNAL_SPEC_STRING
+    };
+
+    /*
+     * Length modifiers of integer sequences.
+     */
+    enum
+    {
+        SLOG_INTERNAL_LENGTH_INT,
+        SLOG_INTERNAL_LENGTH_LONG,
+        SLOG_INTERNAL_LENGTH_LONG_LONG,
+        SLOG_INTERNAL_LENGTH_SIZE
+    };
+
+    /*
+     * A parsed '%' sequence.
+     *
+     * 'Text' and 'Size' point to the text of literal and escape sequences.
+     */
+    typedef struct SLOG_InternalSpec
+    {
+        uint8_t Kind;
+        uint8_t Length;
+        uint8_t Base;
+        char Conversion;
+        int Width;
+        int Precision;
+        const char * Text;
+        size_t Size;
+    } SLOG_InternalSpec;
+
+    /*
+     * Value of an argument fetched for a SLOG_InternalSpec.
+     */
+    typedef union SLOG_InternalArg
+    {
+        int64_t I;
+        uint64_t U;
+        double D;
+        const char * S;
+    } SLOG_InternalArg;
+
+    /*
+     * Parse the '%' sequence at 'c' into 'spec' and return the character after it.
+     */
+    const char * SLOG_InternalParseSpec(const char * c, SLOG_InternalSpec * spec)
+    {
+        const char * sequence = c++;
+
+        spec->Kind = SLOG_INTERNAL_SPEC_LITERAL;
+        spec->Length = SLOG_INTERNAL_LENGTH_INT;
+        spec->Base = 10;
+        spec->Conversion = 0;
+        spec->Width = -1;
+        spec->Precision = -1;
+        spec->Text = sequence;
+
+        if (*c == '=')
+        {
+            const char * color = ++c;
+
+            /*
+             * Color sequences are always 5 characters long.
+             */
+            if (!color[0] || !color[1] || !color[2] || !color[3] || !color[4])
+            {
+                spec->Size = SHRN_STRLEN(sequence);
+                return sequence + spec->Size;
+            }
+
+            spec->Kind = SLOG_INTERNAL_SPEC_ESCAPE;
+            spec->Text = SLOG_InternalColorEscape(color)->Text;
+            spec->Size = SLOG_InternalColorEscape(color)->Size;
+
+            return color + 5;
+        }
+
+        /*
+         * Parse width
+         */
+        if (*c >= '0' && *c <= '9')
+        {
+            spec->Width = 0;
+
+            while (*c >= '0' && *c <= '9')
+                spec->Width = spec->Width * 10 + (*c++ - '0');
+        }
+
+        /*
+         * Parse precision
+         */
+        if (*c == '.')
+        {
+            c++;
+            spec->Precision = 0;
+
+            while (*c >= '0' && *c <= '9')
+                spec->Precision = spec->Precision * 10 + (*c++ - '0');
+        }
+
+        /*
+         * Parse modifier flags. They are only flags when followed by a length
+         * or an integer type, otherwise they are conversions of their own.
+         * Only look past them, 'c' may be the end of the format.
+         */
+        if (*c == 'o' || *c == 'x')
+        {
+            switch (c[1])
+            {
+                case 'l': case 'z': case 'd': case 'i': case 'u':
+                {
+                    spec->Base = *c == 'o' ? 8 : 16;
+                    c++;
+                }
+            }
+        }
+
+        switch (*c)
+        {
+            case 'l':
+            {
+                c++;
+                spec->Length = SLOG_INTERNAL_LENGTH_LONG;
+
+                if (*c == 'l')
+                {
+                    c++;
+                    spec->Length = SLOG_INTERNAL_LENGTH_LONG_LONG;
+                }
+
+                break;
+            }
+
+            case 'z': c++; spec->Length = SLOG_INTERNAL_LENGTH_SIZE; break;
+        }
+
+        /*
+         * Process arg types
+         */
+        spec->Conversion = *c;
+
+        switch (*c)
+        {
+            case 'b': spec->Kind = SLOG_INTERNAL_SPEC_BOOL; break;
+            case 'c': spec->Kind = SLOG_INTERNAL_SPEC_CHAR; break;
+            case 'p': spec->Kind = SLOG_INTERNAL_SPEC_POINTER; break;
+            case 's': spec->Kind = SLOG_INTERNAL_SPEC_STRING; break;
+
+            case 'd':
+            case 'i':
+            {
+                spec->Kind = SLOG_INTERNAL_SPEC_INT;
+
+                break;
+            }
+
+            case 'o': spec->Base = 8; spec->Kind = SLOG_INTERNAL_SPEC_UINT; break;
+            case 'x': spec->Base = 16; spec->Kind = SLOG_INTERNAL_SPEC_UINT; break;
+            case 'X': spec->Base = 16; spec->Kind = SLOG_INTERNAL_SPEC_UINT; break;
+            case 'u': spec->Kind = SLOG_INTERNAL_SPEC_UINT; break;
+
+            case 'e':
+            case 'f':
+            case 'g':
+            {
+                spec->Kind = SLOG_INTERNAL_SPEC_DOUBLE;
+
+                break;
+            }
+
+            case '%':
+            {
+                spec->Text = c;
+                spec->Size = 1;
+
+                return c + 1;
+            }
+
+            /*
+             * Unknown sequences are copied as they are.
+             */
+            default:
+            {
+                if (*c)
+                    c++;
+
+                spec->Size = c - sequence;
+
+                return c;
+            }
+        }
+
+        /*
+         * End of '%' sequence
+         */
+        return c + 1;
+    }
+
+    /*
+     * Fetch the argument of 'spec' from 'ap'.
+     */
+    SLOG_InternalArg SLOG_InternalFetchArg(const SLOG_InternalSpec * spec, va_list * ap)
+    {
+        SLOG_InternalArg arg;
+
+        arg.U = 0;
+
+        switch (spec->Kind)
+        {
+            case SLOG_INTERNAL_SPEC_BOOL:
+            case SLOG_INTERNAL_SPEC_CHAR:
+            {
+                arg.I = va_arg(*ap, int);
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_INT:
+            {
+                switch (spec->Length)
+                {
+                    case SLOG_INTERNAL_LENGTH_LONG: arg.I = va_arg(*ap, long); break;
+                    case SLOG_INTERNAL_LENGTH_LONG_LONG: arg.I = va_arg(*ap, long long); break;
+                    case SLOG_INTERNAL_LENGTH_SIZE: arg.I = va_arg(*ap, ssize_t); break;
+                    default: arg.I = va_arg(*ap, int); break;
+                }
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_UINT:
+            {
+                switch (spec->Length)
+                {
+                    case SLOG_INTERNAL_LENGTH_LONG: arg.U = va_arg(*ap, unsigned long); break;
+                    case SLOG_INTERNAL_LENGTH_LONG_LONG: arg.U = va_arg(*ap, unsigned long long); break;
+                    case SLOG_INTERNAL_LENGTH_SIZE: arg.U = va_arg(*ap, size_t); break;
+                    default: arg.U = va_arg(*ap, unsigned int); break;
+                }
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_DOUBLE: arg.D = va_arg(*ap, double); break;
+            case SLOG_INTERNAL_SPEC_POINTER: arg.U = (uintptr_t)va_arg(*ap, void *); break;
+            case SLOG_INTERNAL_SPEC_STRING: arg.S = va_arg(*ap, const char *); break;
+        }
+
+        return arg;
+    }
+
+    /*
+     * Render 'spec' with its argument 'arg' into 'out'.
+     */
+    void SLOG_InternalRenderSpec(SLOG_InternalBuffer * out, const SLOG_InternalSpec * spec, SLOG_InternalArg arg)
+    {
+        switch (spec->Kind)
+        {
+            case SLOG_INTERNAL_SPEC_LITERAL:
+            {
+                SLOG_InternalBufferAppend(out, spec->Text, spec->Size);
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_ESCAPE:
+            {
+            #ifndef SLOG_NO_COLOR
+                if (out->Color)
+                    SLOG_InternalBufferAppend(out, spec->Text, spec->Size);
+            #endif
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_BOOL:
+            {
+                SLOG_InternalBufferAppendP(out, arg.I ? "true" : "false");
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_CHAR:
+            {
+                SLOG_InternalBufferAppendC(out, (char)arg.I);
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_INT:
+            {
+                SLOG_InternalBufferAppendInt(out, arg.I < 0 ? (uint64_t)0 - arg.U : arg.U, arg.I < 0, spec->Base, spec->Width, 1);
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_UINT:
+            {
+                SLOG_InternalBufferAppendInt(out, arg.U, 0, spec->Base, spec->Width, spec->Conversion != 'x');
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_DOUBLE:
+            {
+                SLOG_InternalBufferAppendDouble(out, arg.D, spec->Conversion, spec->Precision);
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_POINTER:
+            {
+                SLOG_InternalBufferAppendInt(out, arg.U, 0, 16, -1, 1);
+
+                break;
+            }
+
+            case SLOG_INTERNAL_SPEC_STRING:
+            {
+                SLOG_InternalBufferAppendP(out, arg.S);
+
+                break;
+            }
+        }
+    }
+
+    /*
+     * Walk 'fmt' once, copying literal spans in bulk and rendering every
+     * '%' sequence straight into 'out'.
+     */
+    void SLOG_InternalFormatV(SLOG_InternalBuffer * out, const char * fmt, va_list * ap)
+    {
+        const char * c = fmt;
+
+        while (*c)
+        {
+            const char * literal = c;
+
+            SLOG_InternalSpec spec;
+
+            while (*c && *c != '%')
+                c++;
+
+            if (c != literal)
+                SLOG_InternalBufferAppend(out, literal, c - literal);
+
+            if (!*c)
+                break;
+
+            c = SLOG_InternalParseSpec(c, &spec);
+
+            SLOG_InternalRenderSpec(out, &spec, SLOG_InternalFetchArg(&spec, ap));
+        }
+    }
+
+    /*
+     * A compiled format.
+     *
+     * Literal spans and '%%' are merged into literal operations, color sequences
+     * become escape operations pointing into SLOG_InternalColorEscapes and every
+     * other operation renders one argument. The text of literals follows 'Ops'
+     * in the same allocation.
+     */
+    struct SLOGFormatProgram
+    {
+        SLOG_InternalSpec * Ops;
+        size_t OpCount;
+        uint32_t Id;
+        const char * Format;
+        size_t FormatSize;
+        size_t File;
+    };
+
+    /*
+     * Number of formats compiled so far, used to give every program a unique id.
+     */
+    static size_t SLOGFormatCount = 0;
+
+    /*
+     * Parse 'fmt' into 'ops' and copy its literal text into 'text'.
+     *
+     * With 'ops' set to NULL nothing is written, it only measures how many
+     * operations and how much text the program needs.
+     *
+     * Returns the number of operations.
+     */
+    size_t SLOG_InternalCompileFormat(const char * fmt, SLOG_InternalSpec * ops, SLOG_InternalBuffer * text)
+    {
+        const char * c = fmt;
+
+        size_t count = 0;
+
+        int lastLiteral = 0;
+
+        while (*c)
+        {
+            const char * literal = c;
+
+            size_t start = text->Size;
+
+            SLOG_InternalSpec spec;
+
+            spec.Kind = SLOG_INTERNAL_SPEC_LITERAL;
+
+            while (*c && *c != '%')
+                c++;
+
+            SLOG_InternalBufferAppend(text, literal, c - literal);
+
+            if (*c)
+            {
+                c = SLOG_InternalParseSpec(c, &spec);
+
+                if (spec.Kind == SLOG_INTERNAL_SPEC_LITERAL)
+                    SLOG_InternalBufferAppend(text, spec.Text, spec.Size);
+            }
+
+            /*
+             * Extend the previous literal when nothing is in between.
+             */
+            if (text->Size != start)
+            {
+                if (!lastLiteral)
+                {
+                    if (ops)
+                    {
+                        ops[count].Kind = SLOG_INTERNAL_SPEC_LITERAL;
+                        ops[count].Text = text->Data + start;
+                        ops[count].Size = 0;
+                    }
+
+                    count++;
+                }
+
+                if (ops)
+                    ops[count - 1].Size += text->Size - start;
+
+                lastLiteral = 1;
+            }
+
+            if (spec.Kind != SLOG_INTERNAL_SPEC_LITERAL)
+            {
+                if (ops)
+                    ops[count] = spec;
+
+                count++;
+
+                lastLiteral = 0;
+            }
+        }
+
+        return count;
+    }
+
+    /*
+     * Run 'program' with the arguments in 'ap'.
+     */
+    void SLOG_InternalExecuteV(SLOG_InternalBuffer * out, const SLOGFormatProgram * program, va_list * ap)
+    {
+        const SLOG_InternalSpec * op = program->Ops;
+        const SLOG_InternalSpec * end = op + program->OpCount;
+
+        for (; op != end; op++)
+        {
+            if (op->Kind == SLOG_INTERNAL_SPEC_LITERAL)
+                SLOG_InternalBufferAppend(out, op->Text, op->Size);
+            else
+                SLOG_InternalRenderSpec(out, op, SLOG_InternalFetchArg(op, ap));
+        }
+    }
+
+    /*
+     * Copy the arguments of 'program' from 'ap' into 'buf' to format them later
+     * with SLOG_InternalExecuteCaptured. Strings are copied as their 32-bit length
+     * followed by their characters, every other argument as a SLOG_InternalArg.
+     *
+     * Returns the size of the captured arguments, nothing is written past 'cap'.
+     */
+    size_t SLOG_InternalCaptureV(char * buf, size_t cap, const SLOGFormatProgram * program, va_list * ap)
+    {
+        const SLOG_InternalSpec * op = program->Ops;
+        const SLOG_InternalSpec * end = op + program->OpCount;
+
+        size_t size = 0;
+
+        for (; op != end; op++)
+        {
+            SLOG_InternalArg arg;
+
+            if (op->Kind == SLOG_INTERNAL_SPEC_LITERAL || op->Kind == SLOG_INTERNAL_SPEC_ESCAPE)
+                continue;
+
+            arg = SLOG_InternalFetchArg(op, ap);
+
+            if (op->Kind == SLOG_INTERNAL_SPEC_STRING)
+            {
+                uint32_t length = (uint32_t)SHRN_STRLEN(arg.S);
+
+                if (size + sizeof(length) + length <= cap)
+                {
+                    SHRN_MEMCPY(buf + size, &length, sizeof(length));
+                    SHRN_MEMCPY(buf + size + sizeof(length), arg.S, length);
+                }
+
+                size += sizeof(length) + length;
+            }
+            else
+            {
+                if (size + sizeof(arg) <= cap)
+                    SHRN_MEMCPY(buf + size, &arg, sizeof(arg));
+
+                size += sizeof(arg);
+            }
+        }
+
+        return size;
+    }
+
+    /*
+     * Run 'program' with arguments captured by SLOG_InternalCaptureV.
+     */
+    void SLOG_InternalExecuteCaptured(SLOG_InternalBuffer * out, const SLOGFormatProgram * program, const char * args)
+    {
+        const SLOG_InternalSpec * op = program->Ops;
+        const SLOG_InternalSpec * end = op + program->OpCount;
+
+        for (; op != end; op++)
+        {
+            SLOG_InternalArg arg;
+
+            switch (op->Kind)
+            {
+                case SLOG_INTERNAL_SPEC_LITERAL:
+                {
+                    SLOG_InternalBufferAppend(out, op->Text, op->Size);
+
+                    break;
+                }
+
+                case SLOG_INTERNAL_SPEC_ESCAPE:
+                {
+                    arg.U = 0;
+
+                    SLOG_InternalRenderSpec(out, op, arg);
+
+                    break;
+                }
+
+                case SLOG_INTERNAL_SPEC_STRING:
+                {
+                    uint32_t length;
+
+                    SHRN_MEMCPY(&length, args, sizeof(length));
+                    SLOG_InternalBufferAppend(out, args + sizeof(length), length);
+
+                    args += sizeof(length) + length;
+
+                    break;
+                }
+
+                default:
+                {
+                    SHRN_MEMCPY(&arg, args, sizeof(arg));
+                    SLOG_InternalRenderSpec(out, op, arg);
+
+                    args += sizeof(arg);
+
+                    break;
+                }
+            }
+        }
+    }
+
+    char * SLOGVFormat(const char * fmt, va_list ap)
+    {
+        SLOG_InternalBuffer out;
+
+        va_list args;
+        va_copy(args, ap);
+
+        out.Data = SUTLStringNew();
+        out.Size = 0;
+        out.Capacity = 0;
+        out.Growable = 1;
+        out.Color = SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
+
+        SLOG_InternalFormatV(&out, fmt, &args);
+
+        va_end(args);
+
+        /*
+         * Shrink the string from its capacity to the formatted size.
+         */
+        SUTLStringResize(out.Data, out.Size);
+
+        return out.Data;
+    }
+
+    char * SLOGFormat(const char * fmt, ...)
+    {
+        char * res;
+
+        va_list ap;
+        va_start(ap, fmt);
+
+        res = SLOGVFormat(fmt, ap);
+
+        va_end(ap);
+
+        return res;
+    }
+
+    size_t SLOGVFormatTo(char * buf, size_t cap, const char * fmt, va_list ap)
+    {
+        SLOG_InternalBuffer out;
+
+        va_list args;
+        va_copy(args, ap);
+
+        out.Data = buf;
+        out.Size = 0;
+        out.Capacity = cap ? cap - 1 : 0;
+        out.Growable = 0;
+        out.Color = SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
+
+        SLOG_InternalFormatV(&out, fmt, &args);
+
+        va_end(args);
+
+        if (cap)
+            buf[out.Size < out.Capacity ? out.Size : out.Capacity] = 0;
+
+        return out.Size;
+    }
+
+    size_t SLOGFormatTo(char * buf, size_t cap, const char * fmt, ...)
+    {
+        size_t res;
+
+        va_list ap;
+        va_start(ap, fmt);
+
+        res = SLOGVFormatTo(buf, cap, fmt, ap);
+
+        va_end(ap);
+
+        return res;
+    }
+
+    /*
+     * Compile 'fmt' into one allocation, taken by SLOG_InternalSiteAlloc for
+     * a call site or SHRN_MALLOC otherwise. Returns NULL if it failed.
+     */
+    SLOGFormatProgram * SLOG_InternalCompileProgram(const char * fmt, int site)
+    {
+        SLOGFormatProgram * program;
+        size_t size;
+
+        SLOG_InternalBuffer text;
+
+        size_t opCount;
+        size_t formatSize;
+
+        /*
+         * Measure first so the program, its operations and its text fit in one allocation.
+         */
+        text.Data = NULL;
+        text.Size = 0;
+        text.Capacity = 0;
+        text.Growable = 0;
+        text.Color = SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
+
+        opCount = SLOG_InternalCompileFormat(fmt, NULL, &text);
+
+        formatSize = SHRN_STRLEN(fmt);
+
+        size = sizeof(SLOGFormatProgram) + opCount * sizeof(SLOG_InternalSpec) + text.Size + formatSize;
+
+        program = (SLOGFormatProgram *)(site ? SLOG_InternalSiteAlloc(size) : SHRN_MALLOC(size));
+
+        if (!program)
+            return NULL;
+
+        program->Ops = (SLOG_InternalSpec *)(program + 1);
+        program->OpCount = opCount;
+        program->Id = (uint32_t)SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGFormatCount, 1);
+        program->File = 0;
+
+        text.Data = (char *)(program->Ops + opCount);
+        text.Capacity = text.Size;
+        text.Size = 0;
+
+        SLOG_InternalCompileFormat(fmt, program->Ops, &text);
+
+        /*
+         * Keep the format itself for binary output.
+         */
+        program->Format = text.Data + text.Size;
+        program->FormatSize = formatSize;
+
+        SHRN_MEMCPY(text.Data + text.Size, fmt, formatSize);
+
+        return program;
+    }
+
+    SLOGFormatProgram * SLOGCompileFormat(const char * fmt)
+    {
+        return SLOG_InternalCompileProgram(fmt, 0);
+    }
+
+    void SLOGFreeFormat(SLOGFormatProgram * program)
+    {
+        SLOG_InternalSiteFree(program);
+    }
+
+    const SLOGFormatProgram * SLOGCompileFormatOnce(SLOGFormatProgram ** cache, const char * fmt)
+    {
+        SLOGFormatProgram * program = (SLOGFormatProgram *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(cache);
+
+        if (!program)
+        {
+            SLOGFormatProgram * compiled = SLOG_InternalCompileProgram(fmt, 1);
+
+            if (!compiled)
+                return NULL;
+
+            /*
+             * Another thread may have compiled it at the same time, keep the first program.
+             */
+            if (SLOG_INTERNAL_ATOMIC_CAS_PTR(cache, &program, compiled))
+                program = compiled;
+            else
+                SLOGFreeFormat(compiled);
+        }
+
+        return program;
+    }
+
+    char * SLOGVFormatCompiled(const SLOGFormatProgram * program, va_list ap)
+    {
+        SLOG_InternalBuffer out;
+
+        va_list args;
+        va_copy(args, ap);
+
+        out.Data = SUTLStringNew();
+        out.Size = 0;
+        out.Capacity = 0;
+        out.Growable = 1;
+        out.Color = SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
+
+        SLOG_InternalExecuteV(&out, program, &args);
+
+        va_end(args);
+
+        SUTLStringResize(out.Data, out.Size);
+
+        return out.Data;
+    }
+
+    char * SLOGFormatCompiled(const SLOGFormatProgram * program, ...)
+    {
+        char * res;
+
+        va_list ap;
+        va_start(ap, program);
+
+        res = SLOGVFormatCompiled(program, ap);
+
+        va_end(ap);
+
+        return res;
+    }
+
+    size_t SLOGVFormatCompiledTo(const SLOGFormatProgram * program, char * buf, size_t cap, va_list ap)
+    {
+        SLOG_InternalBuffer out;
+
+        va_list args;
+        va_copy(args, ap);
+
+        out.Data = buf;
+        out.Size = 0;
+        out.Capacity = cap ? cap - 1 : 0;
+        out.Growable = 0;
+        out.Color = SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
+
+        SLOG_InternalExecuteV(&out, program, &args);
+
+        va_end(args);
+
+        if (cap)
+            buf[out.Size < out.Capacity ? out.Size : out.Capacity] = 0;
+
+        return out.Size;
+    }
+
+    size_t SLOGFormatCompiledTo(const SLOGFormatProgram * program, char * buf, size_t cap, ...)
+    {
+        size_t res;
+
+        va_list ap;
+        va_start(ap, cap);
+
+        res = SLOGVFormatCompiledTo(program, buf, cap, ap);
+
+        va_end(ap);
+
+        return res;
+    }
+
+    size_t SLOGFormatCachedTo(SLOGFormatProgram ** cache, char * buf, size_t cap, const char * fmt, ...)
+    {
+        const SLOGFormatProgram * program = SLOGCompileFormatOnce(cache, fmt);
+
+        size_t res;
+
+        va_list ap;
+
+        if (!program)
+        {
+            if (cap)
+                buf[0] = '\0';
+
+            return 0;
+        }
+
+        va_start(ap, fmt);
+
+        res = SLOGVFormatCompiledTo(program, buf, cap, ap);
+
+        va_end(ap);
+
+        return res;
+    }
+
+    static FILE * SLOGOutFile;
+    int SLOGLogFilterLevel = 0;
+    static int SLOGColorMode = SLOG_COLOR_AUTO;
+
+    void SLOG_InternalUpdateColor()
+    {
+    #ifdef SLOG_NO_COLOR
+        SLOG_INTERNAL_ATOMIC_STORE_INT(&SLOGColorEnabled, 0);
+    #else
+        FILE * file = (FILE *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGOutFile);
+
+        switch (SLOGColorMode)
+        {
+            case SLOG_COLOR_ALWAYS: SLOG_INTERNAL_ATOMIC_STORE_INT(&SLOGColorEnabled, 1); break;
+            case SLOG_COLOR_NEVER: SLOG_INTERNAL_ATOMIC_STORE_INT(&SLOGColorEnabled, 0); break;
+            default: SLOG_INTERNAL_ATOMIC_STORE_INT(&SLOGColorEnabled, file && SLOG_INTERNAL_ISATTY(file)); break;
+        }
+    #endif
+    }
+
+    /*
+     * Names and colors of the built-in levels.
+     */
+    static const char * const SLOG_InternalLevelNames[] = { "Trace:", "Debug:", "Info:", "Warning:", "Error:", "FatalError:" };
+    static const int SLOG_InternalLevelColors[] = { 5, 4, 6, 3, 1, 1 };
+
+    /*
+     * Define this if threads aren't available. Asynchronous logging
+     * will be unavailable.
+     */
+    #ifndef SLOG_NO_THREADS
+        #ifdef _WIN32
+            typedef HANDLE SLOG_InternalThread;
+            typedef CRITICAL_SECTION SLOG_InternalMutex;
+            typedef CONDITION_VARIABLE SLOG_InternalCond;
+
+            #define SLOG_INTERNAL_THREAD_RESULT DWORD WINAPI
+
+            #define SLOG_InternalThreadStart(thread, func, arg)  ((*(thread) = CreateThread(NULL, 0, func, arg, 0, NULL)) != NULL)
+            #define SLOG_InternalThreadJoin(thread)              (WaitForSingleObject(thread, INFINITE), CloseHandle(thread))
+            #define SLOG_InternalYield()                         SwitchToThread()
+
+            #define SLOG_InternalMutexInit(mutex)                InitializeCriticalSection(mutex)
+            #define SLOG_InternalMutexDestroy(mutex)             DeleteCriticalSection(mutex)
+            #define SLOG_InternalMutexLock(mutex)                EnterCriticalSection(mutex)
+            #define SLOG_InternalMutexUnlock(mutex)              LeaveCriticalSection(mutex)
+
+            #define SLOG_InternalCondInit(cond)                  InitializeConditionVariable(cond)
+            #define SLOG_InternalCondDestroy(cond)
+            #define SLOG_InternalCondWait(cond, mutex)           SleepConditionVariableCS(cond, mutex, INFINITE)
+            #define SLOG_InternalCondTimedWait(cond, mutex, ms)  SleepConditionVariableCS(cond, mutex, ms)
+            #define SLOG_InternalCondSignal(cond)                WakeConditionVariable(cond)
+            #define SLOG_InternalCondBroadcast(cond)             WakeAllConditionVariable(cond)
+        #else
+            #include <pthread.h>
+            #include <sched.h>
+
+            typedef pthread_t SLOG_InternalThread;
+            typedef pthread_mutex_t SLOG_InternalMutex;
+            typedef pthread_cond_t SLOG_InternalCond;
+
+            #define SLOG_INTERNAL_THREAD_RESULT void *
+
+            #define SLOG_InternalThreadStart(thread, func, arg)  (pthread_create(thread, NULL, func, arg) == 0)
+            #define SLOG_InternalThreadJoin(thread)              pthread_join(thread, NULL)
+            #define SLOG_InternalYield()                         sched_yield()
+
+            #define SLOG_InternalMutexInit(mutex)                pthread_mutex_init(mutex, NULL)
+            #define SLOG_InternalMutexDestroy(mutex)             pthread_mutex_destroy(mutex)
+            #define SLOG_InternalMutexLock(mutex)                pthread_mutex_lock(mutex)
+            #define SLOG_InternalMutexUnlock(mutex)              pthread_mutex_unlock(mutex)
+
+            #define SLOG_InternalCondInit(cond)                  pthread_cond_init(cond, NULL)
+            #define SLOG_InternalCondDestroy(cond)               pthread_cond_destroy(cond)
+            #define SLOG_InternalCondWait(cond, mutex)           pthread_cond_wait(cond, mutex)
+            #define SLOG_InternalCondSignal(cond)                pthread_cond_signal(cond)
+            #define SLOG_InternalCondBroadcast(cond)             pthread_cond_broadcast(cond)
+
+            void SLOG_InternalCondTimedWait(SLOG_InternalCond * cond, SLOG_InternalMutex * mutex, unsigned ms)
+            {
+                struct timespec deadline;
+
+                clock_gettime(CLOCK_REALTIME, &deadline);
+
+                deadline.tv_sec += ms / 1000;
+                deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+
+                if (deadline.tv_nsec >= 1000000000L)
+                {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+
+                pthread_cond_timedwait(cond, mutex, &deadline);
+            }
+        #endif
+    #endif
+
+    /*
+     * Number of encodings, and the slot of a rendering in 'encoding' with or
+     * without colors among the SLOG_INTERNAL_RENDERS renderings of a log.
+     */
+    #define SLOG_INTERNAL_ENCODINGS 3
+    #define SLOG_INTERNAL_RENDERS (SLOG_INTERNAL_ENCODINGS * 2)
+    #define SLOG_INTERNAL_RENDER(encoding, color) ((encoding) * 2 + ((encoding) == SLOG_ENCODING_TEXT && (color)))
+
+    /*
+     * Thread states allocated by SLOGInitWithConfig for SLOGConfig::Preallocate
+     * that no thread uses, linked by 'Next'.
+     */
+    typedef struct SLOG_InternalStatePool
+    {
+        SLOG_InternalThreadState * Free;
+        size_t Count;           /* States allocated for the pool, used or not. */
+    #ifndef SLOG_NO_THREADS
+        SLOG_InternalMutex Mutex;
+    #endif
+    } SLOG_InternalStatePool;
+
+    static SLOG_InternalStatePool SLOGStatePool;
+
+    #ifndef SLOG_NO_THREADS
+        #define SLOG_INTERNAL_LOCK_POOL()   SLOG_InternalMutexLock(&SLOGStatePool.Mutex)
+        #define SLOG_INTERNAL_UNLOCK_POOL() SLOG_InternalMutexUnlock(&SLOGStatePool.Mutex)
+    #else
+        #define SLOG_INTERNAL_LOCK_POOL()
+        #define SLOG_INTERNAL_UNLOCK_POOL()
+    #endif
+
+    void SLOG_InternalFreeThreadState(void * state)
+    {
+        SLOG_InternalThreadState * freed = (SLOG_InternalThreadState *)state;
+
+        while (freed->Oversize)
+        {
+            SLOG_InternalOversize * next = freed->Oversize->Next;
+
+            SHRN_FREE(freed->Oversize);
+
+            freed->Oversize = next;
+        }
+
+        /*
+         * Keep the arena of a pooled state for the next thread.
+         */
+        if (freed->Pooled)
+        {
+            char * arena = freed->Arena;
+            size_t arenaSize = freed->ArenaSize;
+
+            SHRN_MEMSET(freed, 0, sizeof(SLOG_InternalThreadState));
+
+            freed->Arena = arena;
+            freed->ArenaSize = arenaSize;
+            freed->Pooled = 1;
+
+            SLOG_INTERNAL_LOCK_POOL();
+
+            freed->Next = SLOGStatePool.Free;
+            SLOG_INTERNAL_ATOMIC_STORE_PTR(&SLOGStatePool.Free, freed);
+
+            SLOG_INTERNAL_UNLOCK_POOL();
+
+            return;
+        }
+
+        SHRN_FREE(freed->Arena);
+        SHRN_FREE(freed);
+    }
+
+    #ifndef SLOG_NO_THREADS
+        #ifdef _WIN32
+            static DWORD SLOGThreadKey = FLS_OUT_OF_INDEXES;
+            static INIT_ONCE SLOGThreadKeyOnce = INIT_ONCE_STATIC_INIT;
+
+            VOID WINAPI SLOG_InternalThreadExit(PVOID state)
+            {
+                if (state)
+                    SLOG_InternalFreeThreadState(state);
+            }
+
+            BOOL CALLBACK SLOG_InternalCreateThreadKey(PINIT_ONCE once, PVOID param, PVOID * context)
+            {
+                (void)once;
+                (void)param;
+                (void)context;
+
+                SLOGThreadKey = FlsAlloc(SLOG_InternalThreadExit);
+
+                return TRUE;
+            }
+
+            #define SLOG_InternalRegisterThreadState(state)\
+                (InitOnceExecuteOnce(&SLOGThreadKeyOnce, SLOG_InternalCreateThreadKey, NULL, NULL), FlsSetValue(SLOGThreadKey, state))
+        #else
+            static pthread_key_t SLOGThreadKey;
+            static pthread_once_t SLOGThreadKeyOnce = PTHREAD_ONCE_INIT;
+
+            void SLOG_InternalCreateThreadKey()
+            {
+                pthread_key_create(&SLOGThreadKey, SLOG_InternalFreeThreadState);
+            }
+
+            #define SLOG_InternalRegisterThreadState(state)\
+                (pthread_once(&SLOGThreadKeyOnce, SLOG_InternalCreateThreadKey), pthread_setspecific(SLOGThreadKey, state))
+        #endif
+    #else
+        #define SLOG_InternalRegisterThreadState(state) ((void)(state))
+    #endif
+
+    SLOG_InternalThreadState * SLOG_InternalGetThreadState()
+    {
+        SLOG_InternalThreadState * state = SLOGThreadState;
+
+        if (!state)
+        {
+            if (SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGStatePool.Free))
+            {
+                SLOG_INTERNAL_LOCK_POOL();
+
+                state = SLOGStatePool.Free;
+
+                if (state)
+                    SLOG_INTERNAL_ATOMIC_STORE_PTR(&SLOGStatePool.Free, state->Next);
+
+                SLOG_INTERNAL_UNLOCK_POOL();
+            }
+
+            if (!state)
+            {
+                state = (SLOG_InternalThreadState *)SLOG_InternalLogAlloc(sizeof(SLOG_InternalThreadState));
+
+                SHRN_MEMSET(state, 0, sizeof(SLOG_InternalThreadState));
+            }
+
+            SLOG_InternalRegisterThreadState(state);
+
+            SLOGThreadState = state;
+        }
+
+        return state;
+    }
+
+    /*
+     * Start writing a log, its temporaries live until the matching SLOG_InternalArenaLeave.
+     */
+    SLOG_InternalThreadState * SLOG_InternalArenaEnter()
+    {
+        SLOG_InternalThreadState * state = SLOG_InternalGetThreadState();
+
+        state->Depth++;
+
+        return state;
+    }
+
+    /*
+     * Finish writing a log and give back its temporaries, unless the log was
+     * written from within another one.
+     */
+    void SLOG_InternalArenaLeave(SLOG_InternalThreadState * state)
+    {
+        if (--state->Depth)
+            return;
+
+        while (state->Oversize)
+        {
+            SLOG_InternalOversize * next = state->Oversize->Next;
+
+            SHRN_FREE(state->Oversize);
+
+            state->Oversize = next;
+        }
+
+        state->ArenaUsed = 0;
+        state->ArenaLast = NULL;
+
+        if (state->Custom.Reset)
+            state->Custom.Reset(state->Custom.User);
+
+        /*
+         * Pick up a new SLOGConfig::ArenaSize with the next log.
+         */
+        if (state->ArenaSize != SLOGArenaSize)
+        {
+            SHRN_FREE(state->Arena);
+
+            state->Arena = NULL;
+            state->ArenaSize = 0;
+        }
+    }
+
+    void SLOGSetThreadArena(const SLOGArena * arena)
+    {
+        SLOG_InternalThreadState * state = SLOG_InternalGetThreadState();
+
+        if (arena)
+        {
+            state->Custom = *arena;
+        }
+        else
+        {
+            state->Custom.Alloc = NULL;
+            state->Custom.Reset = NULL;
+            state->Custom.User = NULL;
+        }
+    }
+
+    static int SLOGClockSource = SLOG_CLOCK_REALTIME;
+    static int SLOGTimestampDigits = -1;
+
+    /*
+     * Nanoseconds per tick of the time stamp counter as a 32.32 fixed point
+     * number, and ticks per second, measured by SLOG_InternalCalibrateTsc.
+     */
+    static uint64_t SLOGTscScale = 0;
+    static uint64_t SLOGTscPerSecond = 0;
+
+    /*
+     * Measure the time stamp counter against the wall clock for 10ms.
+     */
+    void SLOG_InternalCalibrateTsc()
+    {
+    #ifdef SLOG_INTERNAL_RDTSC
+        uint64_t start = SLOG_InternalNow();
+        uint64_t startTsc = SLOG_INTERNAL_RDTSC();
+        uint64_t end;
+        uint64_t endTsc;
+
+        do
+        {
+            end = SLOG_InternalNow();
+            endTsc = SLOG_INTERNAL_RDTSC();
+        } while (end - start < 10000000);
+
+        SLOGTscScale = ((end - start) << 32) / (endTsc - startTsc);
+        SLOGTscPerSecond = (endTsc - startTsc) * 1000 / ((end - start) / 1000000);
+    #endif
+    }
+
+    /*
+     * Time of a log in nanoseconds since the Unix epoch, read from the
+     * configured clock and never before the previous log of the thread.
+     *
+     * The time stamp counter is converted relative to a wall clock time every
+     * thread reads once a second, so calibration errors don't add up.
+     */
+    uint64_t SLOG_InternalLogTime()
+    {
+        SLOG_InternalThreadState * state = SLOG_InternalGetThreadState();
+
+        uint64_t time;
+
+        switch (SLOGClockSource)
+        {
+        #ifdef SLOG_INTERNAL_RDTSC
+            case SLOG_CLOCK_TSC:
+            {
+                uint64_t tsc = SLOG_INTERNAL_RDTSC();
+
+                if (tsc - state->AnchorTsc < SLOGTscPerSecond)
+                {
+                    time = state->AnchorTime + (((tsc - state->AnchorTsc) * SLOGTscScale) >> 32);
+                }
+                else
+                {
+                    time = SLOG_InternalNow();
+
+                    state->AnchorTsc = tsc;
+                    state->AnchorTime = time;
+                }
+
+                break;
+            }
+        #else
+            case SLOG_CLOCK_TSC:
+        #endif
+            case SLOG_CLOCK_REALTIME_COARSE: time = SLOG_InternalNowCoarse(); break;
+            default: time = SLOG_InternalNow(); break;
+        }
+
+        if (time < state->LastTime)
+            time = state->LastTime;
+
+        state->LastTime = time;
+
+        return time;
+    }
+
+    /*
+     * Render 'time' as 'YYYY-MM-DDTHH:MM:SS.fffZ' into 'out'. The part up to
+     * the seconds is cached per thread and only rendered when the second changes.
+     *
+     * Doesn't allocate, threads without a state, like a signal handler of a
+     * thread that never logged, render every part.
+     */
+    void SLOG_InternalRenderTime(SLOG_InternalBuffer * out, uint64_t time)
+    {
+        SLOG_InternalThreadState * state = SLOGThreadState;
+
+        uint64_t second = time / 1000000000;
+
+        char uncached[20];
+
+        char * text = state ? state->SecondText : uncached;
+
+        if (!state || second != state->Second || !text[0])
+        {
+            /*
+             * Civil date of a day count, from Howard Hinnant's date algorithms.
+             */
+            uint64_t days = second / 86400 + 719468;
+            uint64_t clock = second % 86400;
+            uint64_t era = days / 146097;
+            uint64_t dayOfEra = days - era * 146097;
+            uint64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+            uint64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+            uint64_t monthIndex = (5 * dayOfYear + 2) / 153;
+            uint64_t day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+            uint64_t month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+            uint64_t year = yearOfEra + era * 400 + (month <= 2);
+
+            uint64_t fields[5];
+
+            int i;
+
+            fields[0] = month;
+            fields[1] = day;
+            fields[2] = clock / 3600;
+            fields[3] = clock / 60 % 60;
+            fields[4] = clock % 60;
+
+            SHRN_MEMCPY(text, SLOG_InternalDigitPairs + year / 100 % 100 * 2, 2);
+            SHRN_MEMCPY(text + 2, SLOG_InternalDigitPairs + year % 100 * 2, 2);
+
+            for (i = 0; i < 5; i++)
+            {
+                text[4 + i * 3] = "--T::"[i];
+                SHRN_MEMCPY(text + 5 + i * 3, SLOG_InternalDigitPairs + fields[i] * 2, 2);
+            }
+
+            if (state)
+                state->Second = second;
+        }
+
+        SLOG_InternalBufferAppend(out, text, 19);
+
+        if (SLOGTimestampDigits > 0)
+        {
+            char fraction[10];
+
+            uint32_t nanoseconds = (uint32_t)(time % 1000000000);
+
+            int i;
+
+            for (i = 9; i > 0; i--)
+            {
+                fraction[i] = (char)('0' + nanoseconds % 10);
+                nanoseconds /= 10;
+            }
+
+            fraction[0] = '.';
+
+            SLOG_InternalBufferAppend(out, fraction, SLOGTimestampDigits > 9 ? 10 : SLOGTimestampDigits + 1);
+        }
+
+        SLOG_InternalBufferAppendC(out, 'Z');
+    }
+
+    static int SLOGFileEncoding = SLOG_ENCODING_TEXT;
+
+    /*
+     * Whether 'c' has to be escaped in a JSON string.
+     */
+    #define SLOG_INTERNAL_JSON_ESCAPED(c) ((unsigned char)(c) < 0x20 || (c) == '"' || (c) == '\\')
+
+    #if defined(__AVX2__)
+        #include <immintrin.h>
+
+        #define SLOG_INTERNAL_AVX2
+        #define SLOG_INTERNAL_SSE2
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #include <emmintrin.h>
+
+        #define SLOG_INTERNAL_SSE2
+    #endif
+
+    /*
+     * Return the offset of the first byte of 'data' that is at most 'control',
+     * a quote or 'other', or 'size' if there is none. With AVX2 or SSE2 enabled,
+     * clean blocks of 32 or 16 bytes are skipped with a few vector instructions.
+     */
+    size_t SLOG_InternalScan(const char * data, size_t size, char control, char other)
+    {
+        size_t i = 0;
+
+    #ifdef SLOG_INTERNAL_AVX2
+        {
+            const __m256i quote = _mm256_set1_epi8('"');
+            const __m256i others = _mm256_set1_epi8(other);
+            const __m256i controls = _mm256_set1_epi8(control);
+
+            for (; i + 32 <= size; i += 32)
+            {
+                __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+
+                /*
+                 * Bytes up to 'control' are the ones unchanged by an unsigned minimum with it.
+                 */
+                __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, others)),
+                    _mm256_cmpeq_epi8(_mm256_min_epu8(block, controls), block));
+
+                if (_mm256_movemask_epi8(hits))
+                    break;
+            }
+        }
+    #endif
+
+    #ifdef SLOG_INTERNAL_SSE2
+        {
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i others = _mm_set1_epi8(other);
+            const __m128i controls = _mm_set1_epi8(control);
+
+            for (; i + 16 <= size; i += 16)
+            {
+                __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+
+                __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, others)),
+                    _mm_cmpeq_epi8(_mm_min_epu8(block, controls), block));
+
+                if (_mm_movemask_epi8(hits))
+                    break;
+            }
+        }
+    #endif
+
+        /*
+         * Find the byte in the block that was hit, or check the bytes after the last block.
+         */
+        for (; i < size; i++)
+        {
+            if ((unsigned char)data[i] <= (unsigned char)control || data[i] == '"' || data[i] == other)
+                break;
+        }
+
+        return i;
+    }
+
+    /*
+     * Scan for the first byte that has to be escaped in a JSON string, or
+     * that makes a logfmt value need quotes.
+     */
+    #define SLOG_INTERNAL_JSON_SCAN(data, size)   SLOG_InternalScan(data, size, 0x1F, '\\')
+    #define SLOG_INTERNAL_LOGFMT_SCAN(data, size) SLOG_InternalScan(data, size, ' ', '=')
+
+    /*
+     * Write the JSON escape sequence of 'c' to 'out' and return its size, at most 6.
+     */
+    size_t SLOG_InternalJsonEscape(char * out, char c)
+    {
+        char code;
+
+        switch (c)
+        {
+            case '"': code = '"'; break;
+            case '\\': code = '\\'; break;
+            case '\n': code = 'n'; break;
+            case '\r': code = 'r'; break;
+            case '\t': code = 't'; break;
+            case '\b': code = 'b'; break;
+            case '\f': code = 'f'; break;
+
+            default:
+            {
+                out[0] = '\\';
+                out[1] = 'u';
+                out[2] = '0';
+                out[3] = '0';
+                out[4] = "0123456789abcdef"[(unsigned char)c >> 4];
+                out[5] = "0123456789abcdef"[c & 0xF];
+
+                return 6;
+            }
+        }
+
+        out[0] = '\\';
+        out[1] = code;
+
+        return 2;
+    }
+
+    /*
+     * Append 'size' bytes of 'str' escaped for a JSON string, copying clean runs at once.
+     */
+    void SLOG_InternalAppendJsonString(SLOG_InternalBuffer * out, const char * str, size_t size)
+    {
+        for (;;)
+        {
+            char escape[6];
+
+            size_t clean = SLOG_INTERNAL_JSON_SCAN(str, size);
+
+            SLOG_InternalBufferAppend(out, str, clean);
+
+            if (clean == size)
+                break;
+
+            SLOG_InternalBufferAppend(out, escape, SLOG_InternalJsonEscape(escape, str[clean]));
+
+            str += clean + 1;
+            size -= clean + 1;
+        }
+    }
+
+    /*
+     * Escape the bytes of 'out' from 'start' on for a JSON string in place,
+     * and put them in quotes if 'quote' is set. Nothing is moved unless the
+     * scan finds a byte to escape or quotes are added.
+     */
+    void SLOG_InternalJsonEscapeTail(SLOG_InternalBuffer * out, size_t start, int quote)
+    {
+        char * data;
+
+        size_t size;
+        size_t first;
+        size_t last;
+        size_t shift;
+        size_t extra = 0;
+        size_t i;
+
+        /*
+         * A fixed buffer that overflowed is rendered again by the caller.
+         */
+        if (out->Size > out->Capacity)
+            return;
+
+        size = out->Size - start;
+        first = SLOG_INTERNAL_JSON_SCAN(out->Data + start, size);
+
+        if (first == size && !quote)
+            return;
+
+        /*
+         * Count the bytes the escapes add, hopping from one to the next with
+         * the scan. 'last' ends up after the last one, bytes from there on only
+         * shift as a block.
+         */
+        if (quote)
+        {
+            last = 0;
+            extra = 2;
+        }
+        else
+        {
+            last = first;
+        }
+
+        for (i = first; i < size; i += 1 + SLOG_INTERNAL_JSON_SCAN(out->Data + start + i + 1, size - i - 1))
+        {
+            char escape[6];
+
+            extra += SLOG_InternalJsonEscape(escape, out->Data[start + i]) - 1;
+            last = i + 1;
+        }
+
+        if (SLOG_InternalBufferReserve(out, extra) < extra)
+        {
+            out->Size += extra;
+            return;
+        }
+
+        data = out->Data + start;
+        shift = extra - (quote != 0);
+
+        if (quote)
+        {
+            data[size + extra - 1] = '"';
+            first = 0;
+        }
+
+        SHRN_MEMMOVE(data + last + shift, data + last, size - last);
+
+        /*
+         * Move the bytes up to the last escape from the back, so none is
+         * overwritten before it is moved.
+         */
+        i = last;
+        size = last + shift;
+
+        while (i > first)
+        {
+            char c = data[--i];
+
+            if (SLOG_INTERNAL_JSON_ESCAPED(c))
+            {
+                char escape[6];
+
+                size_t length = SLOG_InternalJsonEscape(escape, c);
+
+                size -= length;
+                SHRN_MEMCPY(data + size, escape, length);
+            }
+            else
+            {
+                data[--size] = c;
+            }
+        }
+
+        if (quote)
+            data[0] = '"';
+
+        out->Size += extra;
+    }
+
+    /*
+     * Append 'size' bytes of 'str' as a logfmt value, in quotes and escaped
+     * like a JSON string if it is empty or has spaces, quotes, '=' or control bytes.
+     */
+    void SLOG_InternalAppendLogfmtValue(SLOG_InternalBuffer * out, const char * str, size_t size)
+    {
+        if (size && SLOG_INTERNAL_LOGFMT_SCAN(str, size) == size)
+        {
+            SLOG_InternalBufferAppend(out, str, size);
+            return;
+        }
+
+        SLOG_InternalBufferAppendC(out, '"');
+        SLOG_InternalAppendJsonString(out, str, size);
+        SLOG_InternalBufferAppendC(out, '"');
+    }
+
+    /*
+     * Append the value of 'field' in 'encoding'.
+     */
+    void SLOG_InternalRenderFieldValue(SLOG_InternalBuffer * out, int encoding, const SLOGField * field)
+    {
+        switch (field->Type)
+        {
+            case SLOG_FIELD_INT:
+            {
+                int64_t value = field->Value.Int;
+
+                SLOG_InternalBufferAppendInt(out, value < 0 ? 0 - (uint64_t)value : (uint64_t)value, value < 0, 10, -1, 0);
+                break;
+            }
+
+            case SLOG_FIELD_UINT:
+                SLOG_InternalBufferAppendInt(out, field->Value.Uint, 0, 10, -1, 0);
+                break;
+
+            case SLOG_FIELD_FLOAT:
+            {
+                double value = field->Value.Float;
+
+                /*
+                 * JSON has no infinities or NaN.
+                 */
+                if (encoding == SLOG_ENCODING_JSON && (value != value || value - value != 0.0))
+                    SLOG_InternalBufferAppend(out, "null", 4);
+                else
+                    SLOG_InternalBufferAppendDouble(out, value, 'g', -1);
+
+                break;
+            }
+
+            case SLOG_FIELD_BOOL:
+                SLOG_InternalBufferAppendP(out, field->Value.Bool ? "true" : "false");
+                break;
+
+            default:
+            {
+                const char * value = field->Value.String ? field->Value.String : "(null)";
+
+                if (encoding == SLOG_ENCODING_JSON)
+                {
+                    SLOG_InternalBufferAppendC(out, '"');
+                    SLOG_InternalAppendJsonString(out, value, SHRN_STRLEN(value));
+                    SLOG_InternalBufferAppendC(out, '"');
+                }
+                else if (encoding == SLOG_ENCODING_LOGFMT)
+                {
+                    SLOG_InternalAppendLogfmtValue(out, value, SHRN_STRLEN(value));
+                }
+                else
+                {
+                    SLOG_InternalBufferAppendP(out, value);
+                }
+
+                break;
+            }
+        }
+    }
+
+    /*
+     * The 'level=' keys of logfmt logs with built-in prefixes, with the
+     * values of JSON logs.
+     */
+    #define SLOG_INTERNAL_LOGFMT_LEVEL(name) { "level=" name " ", sizeof("level=" name " ") - 1 }
+
+    static const SLOG_InternalEscape SLOG_InternalLogfmtLevels[] =
+    {
+        SLOG_INTERNAL_LOGFMT_LEVEL("Trace"),
+        SLOG_INTERNAL_LOGFMT_LEVEL("Debug"),
+        SLOG_INTERNAL_LOGFMT_LEVEL("Info"),
+        SLOG_INTERNAL_LOGFMT_LEVEL("Warning"),
+        SLOG_INTERNAL_LOGFMT_LEVEL("Error"),
+        SLOG_INTERNAL_LOGFMT_LEVEL("FatalError")
+    };
+
+    #undef SLOG_INTERNAL_LOGFMT_LEVEL
+
+    /*
+     * Render the 'site=' key of logfmt logs of 'site'.
+     */
+    void SLOG_InternalRenderSite(SLOG_InternalBuffer * out, const SLOGSite * site)
+    {
+        size_t size = SHRN_STRLEN(site->File);
+
+        int quote = !size || SLOG_INTERNAL_LOGFMT_SCAN(site->File, size) != size;
+
+        SLOG_InternalBufferAppend(out, "site=", 5);
+
+        if (quote)
+        {
+            SLOG_InternalBufferAppendC(out, '"');
+            SLOG_InternalAppendJsonString(out, site->File, size);
+        }
+        else
+        {
+            SLOG_InternalBufferAppend(out, site->File, size);
+        }
+
+        SLOG_InternalBufferAppendC(out, ':');
+        SLOG_InternalBufferAppendInt(out, site->Line < 0 ? 0 : (uint64_t)site->Line, 0, 10, -1, 0);
+
+        if (quote)
+            SLOG_InternalBufferAppendC(out, '"');
+
+        SLOG_InternalBufferAppendC(out, ' ');
+    }
+
+    /*
+     * Render the start of a log of 'level' written at 'time' into 'out', up to
+     * where the message goes. 'prefix' is NULL for the built-in prefix of
+     * 'level', a 'time' of 0 renders no timestamp. 'site' is the call site
+     * of the log for logfmt, or NULL.
+     *
+     * Returns the offset of the message, for SLOG_InternalRenderLogEnd.
+     */
+    size_t SLOG_InternalRenderLogBegin(SLOG_InternalBuffer * out, int encoding, int level, const char * prefix, const SLOGSite * site, uint64_t time)
+    {
+        const SLOG_InternalEscape * colors;
+
+        if (level < SLOG_LEVEL_TRACE)
+            level = SLOG_LEVEL_TRACE;
+        else if (level > SLOG_LEVEL_FATAL)
+            level = SLOG_LEVEL_FATAL;
+
+        if (encoding == SLOG_ENCODING_JSON)
+        {
+            size_t length;
+
+            if (!prefix)
+                prefix = SLOG_InternalLevelNames[level];
+
+            length = SHRN_STRLEN(prefix);
+
+            SLOG_InternalBufferAppendC(out, '{');
+
+            if (time && SLOGTimestampDigits >= 0)
+            {
+                SLOG_InternalBufferAppend(out, "\"ts\":\"", 6);
+                SLOG_InternalRenderTime(out, time);
+                SLOG_InternalBufferAppend(out, "\",", 2);
+            }
+
+            /*
+             * The level is the prefix without its colon.
+             */
+            SLOG_InternalBufferAppend(out, "\"level\":\"", 9);
+            SLOG_InternalAppendJsonString(out, prefix, length && prefix[length - 1] == ':' ? length - 1 : length);
+            SLOG_InternalBufferAppend(out, "\",\"msg\":\"", 9);
+
+            return out->Size;
+        }
+
+        if (encoding == SLOG_ENCODING_LOGFMT)
+        {
+            if (time && SLOGTimestampDigits >= 0)
+            {
+                SLOG_InternalBufferAppend(out, "ts=", 3);
+                SLOG_InternalRenderTime(out, time);
+                SLOG_InternalBufferAppendC(out, ' ');
+            }
+
+            if (prefix)
+            {
+                size_t length = SHRN_STRLEN(prefix);
+
+                SLOG_InternalBufferAppend(out, "level=", 6);
+                SLOG_InternalAppendLogfmtValue(out, prefix, length && prefix[length - 1] == ':' ? length - 1 : length);
+                SLOG_InternalBufferAppendC(out, ' ');
+            }
+            else
+            {
+                SLOG_InternalBufferAppend(out, SLOG_InternalLogfmtLevels[level].Text, SLOG_InternalLogfmtLevels[level].Size);
+            }
+
+            /*
+             * Sites still registering have no rendering yet.
+             */
+            if (site)
+            {
+                const char * rendered = (const char *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&((SLOGSite *)site)->Logfmt);
+
+                if (rendered)
+                    SLOG_InternalBufferAppend(out, rendered, site->LogfmtSize);
+                else
+                    SLOG_InternalRenderSite(out, site);
+            }
+
+            SLOG_InternalBufferAppend(out, "msg=", 4);
+
+            return out->Size;
+        }
+
+        if (time && SLOGTimestampDigits >= 0)
+        {
+            SLOG_InternalRenderTime(out, time);
+            SLOG_InternalBufferAppendC(out, ' ');
+        }
+
+        if (prefix)
+        {
+            SLOG_InternalBufferAppendP(out, prefix);
+        }
+        else
+        {
+            colors = SLOG_InternalColorEscapes[SLOG_InternalLevelColors[level]];
+
+            if (out->Color)
+                SLOG_InternalBufferAppend(out, colors[1].Text, colors[1].Size);
+
+            SLOG_InternalBufferAppendP(out, SLOG_InternalLevelNames[level]);
+
+            if (out->Color)
+                SLOG_InternalBufferAppend(out, colors[0].Text, colors[0].Size);
+        }
+
+        SLOG_InternalBufferAppendC(out, ' ');
+
+        return out->Size;
+    }
+
+    /*
+     * Remove a newline ending the message that starts at 'start'.
+     */
+    void SLOG_InternalTrimNewline(SLOG_InternalBuffer * out, size_t start)
+    {
+        if (out->Size > start && out->Size <= out->Capacity && out->Data[out->Size - 1] == '\n')
+            out->Size--;
+    }
+
+    /*
+     * Render the end of a log after its message, which starts at 'start'.
+     * Logs with 'fields', even if 'count' is 0, get the newline ending the
+     * message after the fields, or one is added.
+     */
+    void SLOG_InternalRenderLogEnd(SLOG_InternalBuffer * out, int encoding, size_t start, const SLOGField * fields, size_t count)
+    {
+        size_t i;
+
+        if (encoding == SLOG_ENCODING_JSON)
+        {
+            SLOG_InternalTrimNewline(out, start);
+            SLOG_InternalJsonEscapeTail(out, start, 0);
+            SLOG_InternalBufferAppendC(out, '"');
+
+            for (i = 0; i < count; i++)
+            {
+                SLOG_InternalBufferAppend(out, ",\"", 2);
+                SLOG_InternalAppendJsonString(out, fields[i].Key, SHRN_STRLEN(fields[i].Key));
+                SLOG_InternalBufferAppend(out, "\":", 2);
+                SLOG_InternalRenderFieldValue(out, encoding, &fields[i]);
+            }
+
+            SLOG_InternalBufferAppend(out, "}\n", 2);
+
+            return;
+        }
+
+        if (encoding == SLOG_ENCODING_LOGFMT)
+        {
+            SLOG_InternalTrimNewline(out, start);
+
+            if (out->Size <= out->Capacity && (out->Size == start || SLOG_INTERNAL_LOGFMT_SCAN(out->Data + start, out->Size - start) != out->Size - start))
+                SLOG_InternalJsonEscapeTail(out, start, 1);
+
+            for (i = 0; i < count; i++)
+            {
+                SLOG_InternalBufferAppendC(out, ' ');
+                SLOG_InternalBufferAppendP(out, fields[i].Key);
+                SLOG_InternalBufferAppendC(out, '=');
+                SLOG_InternalRenderFieldValue(out, encoding, &fields[i]);
+            }
+
+            SLOG_InternalBufferAppendC(out, '\n');
+
+            return;
+        }
+
+        if (fields)
+        {
+            SLOG_InternalTrimNewline(out, start);
+
+            for (i = 0; i < count; i++)
+            {
+                SLOG_InternalBufferAppendC(out, ' ');
+                SLOG_InternalBufferAppendP(out, fields[i].Key);
+                SLOG_InternalBufferAppendC(out, '=');
+                SLOG_InternalRenderFieldValue(out, encoding, &fields[i]);
+            }
+
+            SLOG_InternalBufferAppendC(out, '\n');
+        }
+
+        if (out->Color)
+            SLOG_InternalBufferAppend(out, SLOG_InternalColorEscapes[0][0].Text, SLOG_InternalColorEscapes[0][0].Size);
+    }
+
+    /*
+     * A log being written, either 'Program' with the arguments in 'Args' or
+     * 'Prefix' and 'Message' of SLOGLog, followed by fields if 'Fields' isn't
+     * NULL. 'Site' is the call site of the log if it has one.
+     */
+    typedef struct SLOG_InternalLog
+    {
+        int Level;
+        uint64_t Time;
+        const SLOGSite * Site;
+        const char * Prefix;
+        const char * Message;
+        const SLOGFormatProgram * Program;
+        va_list * Args;
+        const SLOGField * Fields;
+        size_t FieldCount;
+    } SLOG_InternalLog;
+
+    /*
+     * Render 'log' in 'encoding' into 'out'.
+     */
+    void SLOG_InternalRenderLog(SLOG_InternalBuffer * out, int encoding, const SLOG_InternalLog * log)
+    {
+        size_t start = SLOG_InternalRenderLogBegin(out, encoding, log->Level, log->Prefix, log->Site, log->Time);
+
+        if (log->Program)
+        {
+            va_list copy;
+
+            va_copy(copy, *log->Args);
+            SLOG_InternalExecuteV(out, log->Program, &copy);
+            va_end(copy);
+        }
+        else
+        {
+            SLOG_InternalBufferAppendP(out, log->Message);
+        }
+
+        SLOG_InternalRenderLogEnd(out, encoding, start, log->Fields, log->FieldCount);
+    }
+
+    /*
+     * Sinks added by SLOGAddSink. A slot is taken while 'Used' is set and
+     * receives logs while the 'Levels' of its sink aren't 0.
+     */
+    typedef struct SLOG_InternalSink
+    {
+        SLOGSink Sink;
+        size_t Used;
+    } SLOG_InternalSink;
+
+    static SLOG_InternalSink SLOGSinks[SLOG_MAX_SINKS];
+
+    size_t SLOGSinkLevels = 0;
+
+    int SLOGEnabledLevel = 0;
+
+    /*
+     * The lowest level the output file or a sink takes right now.
+     */
+    int SLOG_InternalLowestLevel()
+    {
+        size_t levels = SLOG_INTERNAL_SINK_LEVELS();
+
+        int filter = SLOG_INTERNAL_FILTER_LEVEL();
+        int lowest = 0;
+
+        if (!levels)
+            return filter;
+
+        /*
+         * Levels below 0 share bit 0.
+         */
+        if (levels & 1)
+            return filter < 0 ? filter : -0x7FFFFFFF - 1;
+
+        while (!(levels & 1))
+        {
+            levels >>= 1;
+            lowest++;
+        }
+
+        return filter < lowest ? filter : lowest;
+    }
+
+    /*
+     * Recompute SLOGEnabledLevel after the filter level or the levels of a
+     * sink changed. Checks again after storing it, so the last of several
+     * threads changing them at the same time stores the right level.
+     */
+    void SLOG_InternalUpdateEnabledLevel()
+    {
+        int level;
+
+        do
+        {
+            level = SLOG_InternalLowestLevel();
+
+            SLOG_INTERNAL_ATOMIC_STORE_INT(&SLOGEnabledLevel, level);
+            SLOG_INTERNAL_ATOMIC_FENCE();
+        } while (SLOG_InternalLowestLevel() != level);
+    }
+
+    /*
+     * Recompute SLOGSinkLevels after the levels of a sink changed. Retries
+     * when another thread changed them at the same time.
+     */
+    void SLOG_InternalUpdateSinkLevels()
+    {
+        size_t levels;
+        size_t expected;
+
+        do
+        {
+            int i;
+
+            expected = SLOG_INTERNAL_ATOMIC_LOAD(&SLOGSinkLevels);
+            levels = 0;
+
+            for (i = 0; i < SLOG_MAX_SINKS; i++)
+                levels |= SLOG_INTERNAL_ATOMIC_LOAD(&SLOGSinks[i].Sink.Levels);
+        } while (!SLOG_INTERNAL_ATOMIC_CAS(&SLOGSinkLevels, &expected, levels));
+
+        SLOG_InternalUpdateEnabledLevel();
+    }
+
+    /*
+     * Hand 'log' to every sink taking its level, rendering it at most once in
+     * each encoding and for colors.
+     *
+     * 'rendered' is a rendering of the log in SLOGFileEncoding the caller has
+     * already, or NULL. The other renderings are taken from the arena of
+     * 'state', which is writing the log.
+     */
+    void SLOG_InternalWriteSinks(SLOG_InternalThreadState * state, const SLOG_InternalLog * log, const SLOG_InternalBuffer * rendered)
+    {
+        const SLOG_InternalBuffer * renders[SLOG_INTERNAL_RENDERS] = { NULL };
+
+        SLOG_InternalBuffer buffers[SLOG_INTERNAL_RENDERS];
+
+        size_t bit = SLOG_INTERNAL_LEVEL_BIT(log->Level);
+
+        int i;
+
+        if (rendered)
+            renders[SLOG_INTERNAL_RENDER(SLOGFileEncoding, rendered->Color)] = rendered;
+
+        for (i = 0; i < SLOG_MAX_SINKS; i++)
+        {
+            SLOG_InternalSink * sink = &SLOGSinks[i];
+
+            int index;
+
+            if (!(SLOG_INTERNAL_ATOMIC_LOAD(&sink->Sink.Levels) & bit))
+                continue;
+
+        #ifdef SLOG_NO_COLOR
+            index = SLOG_INTERNAL_RENDER(sink->Sink.Encoding, 0);
+        #else
+            index = SLOG_INTERNAL_RENDER(sink->Sink.Encoding, sink->Sink.Color != 0);
+        #endif
+
+            if (!renders[index])
+            {
+                SLOG_InternalBuffer * out = SLOG_InternalArenaBuffer(state, &buffers[index], index == SLOG_INTERNAL_RENDER(SLOG_ENCODING_TEXT, 1), 512);
+
+                SLOG_InternalRenderLog(out, sink->Sink.Encoding, log);
+
+                renders[index] = out;
+            }
+
+            sink->Sink.Write(sink->Sink.User, log->Level, renders[index]->Data, renders[index]->Size);
+        }
+    }
+
+    /*
+     * Binary log files, written when SLOGConfig::Binary is set and turned back
+     * into text by the slog-decode tool.
+     *
+     * A file starts with SLOG_INTERNAL_BINARY_MAGIC followed by entries. Every
+     * entry starts with its 32-bit size, not counting the size itself, and a
+     * type byte:
+     *
+     *  FORMAT: 32-bit format id and the format string without terminator.
+     *  LOG:    Level byte, 64-bit time in nanoseconds since the Unix epoch,
+     *          32-bit format id and the arguments captured by SLOG_InternalCaptureV.
+     *  TEXT:   Level byte, 64-bit time and text rendered without colors.
+     *
+     * A format is written before the first log using it and can be redefined
+     * later in the same file. Integers are in the byte order of the writer.
+     */
+    #define SLOG_INTERNAL_BINARY_MAGIC      "SLOGBIN1"
+    #define SLOG_INTERNAL_BINARY_MAGIC_SIZE 8
+
+    enum
+    {
+        SLOG_INTERNAL_ENTRY_FORMAT,
+        SLOG_INTERNAL_ENTRY_LOG,
+        SLOG_INTERNAL_ENTRY_TEXT
+    };
+
+    /*
+     * Sizes of the fixed parts of entries, including the size and type.
+     */
+    #define SLOG_INTERNAL_ENTRY_HEADER_SIZE  5
+    #define SLOG_INTERNAL_FORMAT_HEADER_SIZE (SLOG_INTERNAL_ENTRY_HEADER_SIZE + 4)
+    #define SLOG_INTERNAL_TEXT_HEADER_SIZE   (SLOG_INTERNAL_ENTRY_HEADER_SIZE + 1 + 8)
+    #define SLOG_INTERNAL_LOG_HEADER_SIZE    (SLOG_INTERNAL_TEXT_HEADER_SIZE + 4)
+
+    static int SLOGBinary = 0;
+
+    /*
+     * Time of a log if timestamps or binary entries use it, 0 otherwise.
+     */
+    #define SLOG_INTERNAL_LOG_TIME() (SLOGBinary || SLOGTimestampDigits >= 0 ? SLOG_InternalLogTime() : 0)
+
+    /*
+     * Number of binary files started so far. A program's 'File' is the file
+     * its FORMAT entry was last written to.
+     */
+    static size_t SLOGBinaryFile = 1;
+
+    /*
+     * The file that needs SLOG_INTERNAL_BINARY_MAGIC before its first entry.
+     */
+    static FILE * SLOGBinaryPending = NULL;
+
+    /*
+     * Number of threads using the output file. SLOGSetOutputFile waits for it
+     * to drop to zero so the previous file is unused once it returns.
+     */
+    static size_t SLOGActiveWriters = 0;
+
+    #ifdef _WIN32
+        #define SLOG_INTERNAL_LOCK_FILE(f)   _lock_file(f)
+        #define SLOG_INTERNAL_UNLOCK_FILE(f) _unlock_file(f)
+    #else
+        #define SLOG_INTERNAL_LOCK_FILE(f)   flockfile(f)
+        #define SLOG_INTERNAL_UNLOCK_FILE(f) funlockfile(f)
+    #endif
+
+    /*
+     * Get the output file, it stays usable until SLOG_InternalLeaveOutput.
+     */
+    FILE * SLOG_InternalEnterOutput()
+    {
+        SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGActiveWriters, 1);
+
+        return (FILE *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGOutFile);
+    }
+
+    void SLOG_InternalLeaveOutput()
+    {
+        SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGActiveWriters, (size_t)-1);
+    }
+
+    /*
+     * Make 'file' the output file once no other thread is using the current one.
+     */
+    void SLOG_InternalSwapOutput(FILE * file)
+    {
+        SLOG_INTERNAL_ATOMIC_STORE_PTR(&SLOGOutFile, file);
+
+    #ifndef SLOG_NO_THREADS
+        while (SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGActiveWriters, 0))
+            SLOG_InternalYield();
+    #endif
+    }
+
+    /*
+     * Start a binary file on 'file' unless it already has data. The magic is
+     * written with the first entry, so nothing is written to files that never
+     * get a log.
+     */
+    void SLOG_InternalBinaryBegin(FILE * file)
+    {
+        SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGBinaryFile, 1);
+        SLOG_INTERNAL_ATOMIC_STORE_PTR(&SLOGBinaryPending, ftell(file) <= 0 ? file : NULL);
+    }
+
+    /*
+     * Write finished log bytes to 'file' with a single write.
+     */
+    void SLOG_InternalOutputTo(FILE * file, const char * data, size_t size)
+    {
+        if (SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGBinaryPending) == file)
+        {
+            /*
+             * Hold the file so no other entry gets in before the magic.
+             */
+            SLOG_INTERNAL_LOCK_FILE(file);
+
+            if (SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGBinaryPending) == file)
+            {
+                fwrite(SLOG_INTERNAL_BINARY_MAGIC, 1, SLOG_INTERNAL_BINARY_MAGIC_SIZE, file);
+                SLOG_INTERNAL_ATOMIC_STORE_PTR(&SLOGBinaryPending, NULL);
+            }
+
+            fwrite(data, 1, size, file);
+
+            SLOG_INTERNAL_UNLOCK_FILE(file);
+        }
+        else
+        {
+            fwrite(data, 1, size, file);
+        }
+    }
+
+    /*
+     * Pieces of a gathering write.
+     */
+    #ifdef _WIN32
+        typedef struct SLOG_InternalIoVec
+        {
+            void * iov_base;
+            size_t iov_len;
+        } SLOG_InternalIoVec;
+    #else
+        typedef struct iovec SLOG_InternalIoVec;
+    #endif
+
+    #if defined(IOV_MAX) && IOV_MAX < 1024
+        #define SLOG_INTERNAL_GATHER_MAX IOV_MAX
+    #else
+        #define SLOG_INTERNAL_GATHER_MAX 1024
+    #endif
+
+    /*
+     * Write 'count' pieces to the file descriptor of 'file', after anything
+     * buffered by stdio. Gives up on errors other than interruptions.
+     */
+    void SLOG_InternalOutputGather(FILE * file, SLOG_InternalIoVec * iov, int count)
+    {
+    #ifdef _WIN32
+        int fd = _fileno(file);
+    #else
+        int fd = fileno(file);
+    #endif
+
+        SLOG_INTERNAL_LOCK_FILE(file);
+
+        if (SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGBinaryPending) == file)
+        {
+            fwrite(SLOG_INTERNAL_BINARY_MAGIC, 1, SLOG_INTERNAL_BINARY_MAGIC_SIZE, file);
+            SLOG_INTERNAL_ATOMIC_STORE_PTR(&SLOGBinaryPending, NULL);
+        }
+
+        fflush(file);
+
+        while (count)
+        {
+    #ifdef _WIN32
+            int written = iov->iov_len ? _write(fd, iov->iov_base, (unsigned)iov->iov_len) : 0;
+    #else
+            ssize_t written = writev(fd, iov, count);
+
+            if (written < 0 && errno == EINTR)
+                continue;
+    #endif
+
+            if (written < 0)
+                break;
+
+            while (count && (size_t)written >= iov->iov_len)
+            {
+                written -= iov->iov_len;
+                iov++;
+                count--;
+            }
+
+            if (count)
+            {
+                iov->iov_base = (char *)iov->iov_base + written;
+                iov->iov_len -= written;
+            }
+        }
+
+        SLOG_INTERNAL_UNLOCK_FILE(file);
+    }
+
+    /*
+     * Logs buffered by the logging threads when SLOGConfig::FlushSize is set.
+     * They belong to 'File', which may differ from the output file for a
+     * moment after SLOGSetOutputFile.
+     */
+    typedef struct SLOG_InternalPending
+    {
+        char * Data;
+        size_t Size;
+        FILE * File;
+        uint64_t Since; /* Time of the oldest buffered log. */
+    #ifndef SLOG_NO_THREADS
+        SLOG_InternalMutex Mutex;
+    #endif
+    } SLOG_InternalPending;
+
+    static SLOG_InternalPending SLOGPending;
+
+    static size_t SLOGFlushSize = 0;
+    static uint64_t SLOGFlushInterval = 0;
+    static int SLOGFlushLevel = SLOG_LEVEL_ERROR;
+
+    #ifndef SLOG_NO_THREADS
+        #define SLOG_INTERNAL_LOCK_PENDING()   SLOG_InternalMutexLock(&SLOGPending.Mutex)
+        #define SLOG_INTERNAL_UNLOCK_PENDING() SLOG_InternalMutexUnlock(&SLOGPending.Mutex)
+    #else
+        #define SLOG_INTERNAL_LOCK_PENDING()
+        #define SLOG_INTERNAL_UNLOCK_PENDING()
+    #endif
+
+    /*
+     * Write the buffered logs, followed by 'size' bytes of 'data'. Called with the buffer locked.
+     */
+    void SLOG_InternalWritePending(const char * data, size_t size)
+    {
+        SLOG_InternalIoVec iov[2];
+
+        iov[0].iov_base = SLOGPending.Data;
+        iov[0].iov_len = SLOGPending.Size;
+        iov[1].iov_base = (void *)data;
+        iov[1].iov_len = size;
+
+        if (SLOGPending.Size || size)
+            SLOG_InternalOutputGather(SLOGPending.File, iov, size ? 2 : 1);
+
+        SLOGPending.Size = 0;
+    }
+
+    void SLOG_InternalFlushPending()
+    {
+        SLOG_INTERNAL_LOCK_PENDING();
+        SLOG_InternalWritePending(NULL, 0);
+        SLOG_INTERNAL_UNLOCK_PENDING();
+    }
+
+    /*
+     * Write a finished log to 'file' from the logging thread, right away
+     * together with every log before it when 'flush' is set.
+     */
+    void SLOG_InternalOutputLog(FILE * file, const char * data, size_t size, int flush)
+    {
+        if (!SLOGFlushSize)
+        {
+            SLOG_InternalOutputTo(file, data, size);
+
+            if (flush)
+                fflush(file);
+
+            return;
+        }
+
+        SLOG_INTERNAL_LOCK_PENDING();
+
+        if (SLOGPending.File != file)
+        {
+            SLOG_InternalWritePending(NULL, 0);
+
+            SLOGPending.File = file;
+        }
+
+        if (!SLOGPending.Size)
+            SLOGPending.Since = SLOG_InternalNow();
+        else if (!flush && SLOG_InternalNow() - SLOGPending.Since >= SLOGFlushInterval)
+            flush = 1;
+
+        /*
+         * Logs that don't fit are gathered with the buffer instead of copied into it.
+         */
+        if (flush || SLOGPending.Size + size > SLOGFlushSize)
+        {
+            SLOG_InternalWritePending(data, size);
+        }
+        else
+        {
+            SHRN_MEMCPY(SLOGPending.Data + SLOGPending.Size, data, size);
+            SLOGPending.Size += size;
+        }
+
+        SLOG_INTERNAL_UNLOCK_PENDING();
+    }
+
+    void SLOG_InternalFlushOutput()
+    {
+        FILE * file;
+
+        if (SLOGFlushSize)
+            SLOG_InternalFlushPending();
+
+        file = SLOG_InternalEnterOutput();
+
+        if (file)
+            fflush(file);
+
+        SLOG_InternalLeaveOutput();
+    }
+
+    void SLOG_InternalBinaryAppendU32(SLOG_InternalBuffer * out, uint32_t val)
+    {
+        SLOG_InternalBufferAppend(out, (const char *)&val, sizeof(val));
+    }
+
+    /*
+     * Append the fixed part of a TEXT or LOG entry with 'size' bytes after the time.
+     */
+    void SLOG_InternalBinaryAppendEntry(SLOG_InternalBuffer * out, int type, int level, uint64_t time, size_t size)
+    {
+        SLOG_InternalBinaryAppendU32(out, (uint32_t)(SLOG_INTERNAL_TEXT_HEADER_SIZE - 4 + size));
+        SLOG_InternalBufferAppendC(out, (char)type);
+        SLOG_InternalBufferAppendC(out, (char)level);
+        SLOG_InternalBufferAppend(out, (const char *)&time, sizeof(time));
+    }
+
+    /*
+     * Append a LOG entry for binary file number 'file', preceded by the FORMAT
+     * entry of 'program' unless it was written to that file already. A 'file'
+     * of 0 always writes the FORMAT entry.
+     *
+     * Returns whether the FORMAT entry was written. The caller marks it with
+     * SLOG_InternalBinaryMarkFormat once the entries are in the file or ahead
+     * of every later entry.
+     */
+    int SLOG_InternalBinaryAppendLog(SLOG_InternalBuffer * out, int level, uint64_t time, const SLOGFormatProgram * program, const char * args, size_t size, size_t file)
+    {
+        int define = !file || SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&program->File) != file;
+
+        if (define)
+        {
+            SLOG_InternalBinaryAppendU32(out, (uint32_t)(SLOG_INTERNAL_FORMAT_HEADER_SIZE - 4 + program->FormatSize));
+            SLOG_InternalBufferAppendC(out, SLOG_INTERNAL_ENTRY_FORMAT);
+            SLOG_InternalBinaryAppendU32(out, program->Id);
+            SLOG_InternalBufferAppend(out, program->Format, program->FormatSize);
+        }
+
+        SLOG_InternalBinaryAppendEntry(out, SLOG_INTERNAL_ENTRY_LOG, level, time, 4 + size);
+        SLOG_InternalBinaryAppendU32(out, program->Id);
+        SLOG_InternalBufferAppend(out, args, size);
+
+        return define;
+    }
+
+    void SLOG_InternalBinaryMarkFormat(const SLOGFormatProgram * program, size_t file)
+    {
+        SLOG_INTERNAL_ATOMIC_STORE(&((SLOGFormatProgram *)program)->File, file);
+    }
+
+    #ifndef SLOG_NO_THREADS
+        #define SLOG_INTERNAL_CACHE_LINE 64
+
+        /*
+         * Header of a queued record, followed by its bytes.
+         *
+         * 'Sequence' equals the queue position the record is free for, and
+         * that position + 1 once a producer has published it.
+         */
+        typedef struct SLOG_InternalRecord
+        {
+            size_t Sequence;
+            size_t Size;
+            int Level;
+            int Deferred;
+        } SLOG_InternalRecord;
+
+        /*
+         * Bytes of a deferred record, formatted by the writer thread.
+         */
+        typedef struct SLOG_InternalDeferred
+        {
+            const SLOGFormatProgram * Program;
+            const SLOGSite * Site;
+            uint64_t Time;
+            /* Followed by the arguments captured by SLOG_InternalCaptureV. */
+        } SLOG_InternalDeferred;
+
+        /*
+         * Bounded multi-producer single-consumer queue of records after
+         * Dmitry Vyukov's bounded queue. Records are 'Stride' bytes apart,
+         * a multiple of the cache line size, and producers and the consumer
+         * keep their positions on separate cache lines.
+         */
+        typedef struct SLOG_InternalQueue
+        {
+            char Pad0[SLOG_INTERNAL_CACHE_LINE];
+            size_t Head;
+            char Pad1[SLOG_INTERNAL_CACHE_LINE - sizeof(size_t)];
+            size_t Tail;
+            char Pad2[SLOG_INTERNAL_CACHE_LINE - sizeof(size_t)];
+            char * Records;
+            size_t Mask;
+            size_t Stride;
+            size_t RecordSize;
+            void * Memory;
+        } SLOG_InternalQueue;
+
+        typedef struct SLOG_InternalAsync
+        {
+            SLOG_InternalQueue Queue;
+            SLOG_InternalThread Writer;
+            SLOG_InternalMutex Mutex;
+            SLOG_InternalCond Wake;    /* Wakes up the writer thread. */
+            SLOG_InternalCond Drained; /* Broadcast by the writer thread after writing. */
+            SLOG_InternalCond Room;    /* Broadcast by the writer thread when 'Waiting' logs can be queued. */
+            char * Batch;
+            size_t BatchCapacity;
+            unsigned FlushIntervalMs;
+            int Deferred;
+            int FullPolicy[SLOG_LEVEL_COUNT];
+            size_t Waiting;
+            size_t Dropped;            /* Logs dropped since the last report. */
+            size_t Running;
+            size_t Stop;
+        } SLOG_InternalAsync;
+
+        static SLOG_InternalAsync SLOGAsync;
+
+        SLOG_InternalRecord * SLOG_InternalQueueAt(SLOG_InternalQueue * queue, size_t pos)
+        {
+            return (SLOG_InternalRecord *)(queue->Records + (pos & queue->Mask) * queue->Stride);
+        }
+
+        void SLOG_InternalWakeWriter()
+        {
+            SLOG_InternalMutexLock(&SLOGAsync.Mutex);
+            SLOG_InternalCondSignal(&SLOGAsync.Wake);
+            SLOG_InternalMutexUnlock(&SLOGAsync.Mutex);
+        }
+
+        /*
+         * Number of times a logging thread yields for room in the queue before sleeping.
+         */
+        #define SLOG_INTERNAL_FULL_SPINS 64
+
+        /*
+         * Wait until the writer thread frees the record at queue position
+         * 'pos', spinning for the first 'spins' calls.
+         */
+        void SLOG_InternalWaitForRoom(SLOG_InternalQueue * queue, size_t pos, int spins)
+        {
+            if (spins < SLOG_INTERNAL_FULL_SPINS)
+            {
+                SLOG_InternalYield();
+                return;
+            }
+
+            SLOG_InternalMutexLock(&SLOGAsync.Mutex);
+
+            SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGAsync.Waiting, 1);
+
+            /*
+             * Pairs with the fence of the writer thread, either it sees this
+             * thread waiting or this thread sees the freed record. The wait
+             * times out anyway in case the record is taken by another thread.
+             */
+            SLOG_INTERNAL_ATOMIC_FENCE();
+
+            if ((ptrdiff_t)(SLOG_INTERNAL_ATOMIC_LOAD(&SLOG_InternalQueueAt(queue, pos)->Sequence) - pos) < 0)
+            {
+                SLOG_InternalCondSignal(&SLOGAsync.Wake);
+                SLOG_InternalCondTimedWait(&SLOGAsync.Room, &SLOGAsync.Mutex, 1);
+            }
+
+            SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGAsync.Waiting, (size_t)-1);
+
+            SLOG_InternalMutexUnlock(&SLOGAsync.Mutex);
+        }
+
+        /*
+         * Claim the next record of the queue for a log of 'level'. The record
+         * must be published with SLOG_InternalQueuePublish.
+         *
+         * Returns NULL if the log was dropped by the full policy of 'level'.
+         */
+        SLOG_InternalRecord * SLOG_InternalQueueClaim(SLOG_InternalQueue * queue, int level, size_t * claimed)
+        {
+            int policy = SLOGAsync.FullPolicy[level < 0 ? 0 : level >= SLOG_LEVEL_COUNT ? SLOG_LEVEL_COUNT - 1 : level];
+            int spins = 0;
+
+            size_t pos = SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&queue->Head);
+
+            if (policy == SLOG_FULL_DROP_EARLY && pos - SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&queue->Tail) >= (queue->Mask + 1) / 4 * 3)
+            {
+                SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGAsync.Dropped, 1);
+                return NULL;
+            }
+
+            for (;;)
+            {
+                SLOG_InternalRecord * record = SLOG_InternalQueueAt(queue, pos);
+
+                size_t sequence = SLOG_INTERNAL_ATOMIC_LOAD(&record->Sequence);
+
+                if (sequence == pos)
+                {
+                    if (SLOG_INTERNAL_ATOMIC_CAS(&queue->Head, &pos, pos + 1))
+                    {
+                        *claimed = pos;
+                        return record;
+                    }
+                }
+                else if ((ptrdiff_t)(sequence - pos) < 0)
+                {
+                    /*
+                     * The queue is full.
+                     */
+                    if (policy != SLOG_FULL_BLOCK)
+                    {
+                        SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGAsync.Dropped, 1);
+                        return NULL;
+                    }
+
+                    if (!spins)
+                        SLOG_InternalWakeWriter();
+
+                    SLOG_InternalWaitForRoom(queue, pos, spins++);
+
+                    pos = SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&queue->Head);
+                }
+                else
+                {
+                    pos = SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&queue->Head);
+                }
+            }
+        }
+
+        void SLOG_InternalQueuePublish(SLOG_InternalQueue * queue, SLOG_InternalRecord * record, size_t pos)
+        {
+            SLOG_INTERNAL_ATOMIC_STORE(&record->Sequence, pos + 1);
+
+            /*
+             * The writer thread wakes up every flush interval on its own,
+             * only wake it early when the queue is half full.
+             */
+            if (pos - SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&queue->Tail) == (queue->Mask + 1) / 2)
+                SLOG_InternalWakeWriter();
+        }
+
+        /*
+         * Copy a rendered line into the queue. Returns 0 without queueing if
+         * it is too large, dropped logs count as queued.
+         */
+        int SLOG_InternalQueuePush(SLOG_InternalQueue * queue, int level, const char * data, size_t size)
+        {
+            SLOG_InternalRecord * record;
+
+            size_t pos;
+
+            if (size > queue->RecordSize)
+                return 0;
+
+            record = SLOG_InternalQueueClaim(queue, level, &pos);
+
+            if (!record)
+                return 1;
+
+            record->Size = size;
+            record->Level = level;
+            record->Deferred = 0;
+
+            SHRN_MEMCPY(record + 1, data, size);
+
+            SLOG_InternalQueuePublish(queue, record, pos);
+
+            return 1;
+        }
+
+        /*
+         * Capture a log into the queue to be formatted by the writer thread.
+         *
+         * Returns 0 if the arguments don't fit in a record, the log must be
+         * rendered by the caller then. Dropped logs count as queued.
+         */
+        int SLOG_InternalQueueDeferred(SLOG_InternalQueue * queue, int level, uint64_t time, const SLOGSite * site, const SLOGFormatProgram * program, va_list * ap)
+        {
+            SLOG_InternalDeferred header;
+
+            SLOG_InternalRecord * record;
+
+            size_t pos;
+            size_t size;
+
+            if (queue->RecordSize < sizeof(header))
+                return 0;
+
+            header.Program = program;
+            header.Site = site;
+            header.Time = time;
+
+            record = SLOG_InternalQueueClaim(queue, level, &pos);
+
+            if (!record)
+                return 1;
+
+            size = SLOG_InternalCaptureV((char *)(record + 1) + sizeof(header), queue->RecordSize - sizeof(header), program, ap);
+
+            if (size > queue->RecordSize - sizeof(header))
+            {
+                /*
+                 * The record was claimed already, publish it empty.
+                 */
+                record->Size = 0;
+                record->Deferred = 0;
+
+                SLOG_InternalQueuePublish(queue, record, pos);
+
+                return 0;
+            }
+
+            SHRN_MEMCPY(record + 1, &header, sizeof(header));
+
+            record->Size = sizeof(header) + size;
+            record->Level = level;
+            record->Deferred = 1;
+
+            SLOG_InternalQueuePublish(queue, record, pos);
+
+            return 1;
+        }
+
+        /*
+         * Format a deferred record into 'out', or encode it for binary file number 'file'.
+         */
+        void SLOG_InternalRenderDeferred(SLOG_InternalBuffer * out, const SLOG_InternalRecord * record, size_t file)
+        {
+            SLOG_InternalDeferred header;
+
+            SHRN_MEMCPY(&header, record + 1, sizeof(header));
+
+            if (SLOGBinary)
+            {
+                /*
+                 * Batches are written in order, so the format counts as written once it is in the batch.
+                 */
+                if (SLOG_InternalBinaryAppendLog(out, record->Level, header.Time, header.Program,
+                        (const char *)(record + 1) + sizeof(header), record->Size - sizeof(header), file)
+                    && out->Size <= out->Capacity)
+                    SLOG_InternalBinaryMarkFormat(header.Program, file);
+            }
+            else
+            {
+                size_t start = SLOG_InternalRenderLogBegin(out, SLOGFileEncoding, record->Level, NULL, header.Site, header.Time);
+
+                SLOG_InternalExecuteCaptured(out, header.Program, (const char *)(record + 1) + sizeof(header));
+                SLOG_InternalRenderLogEnd(out, SLOGFileEncoding, start, NULL, 0);
+            }
+        }
+
+        /*
+         * Render the warning reporting 'dropped' logs into 'out'.
+         */
+        void SLOG_InternalRenderDropped(SLOG_InternalBuffer * out, size_t dropped)
+        {
+            static const char text[] = " logs dropped, the queue was full.\n";
+
+            char digits[SLOG_INTERNAL_MAX_DIGITS];
+
+            size_t count = SLOG_InternalToStringU64(digits, dropped, 10, 0);
+
+            uint64_t time = SLOG_INTERNAL_LOG_TIME();
+
+            int encoding = SLOGFileEncoding;
+
+            size_t start;
+
+            /*
+             * The time of a text entry is in its header, not in its text.
+             */
+            if (SLOGBinary)
+            {
+                SLOG_InternalBinaryAppendEntry(out, SLOG_INTERNAL_ENTRY_TEXT, SLOG_LEVEL_WARN, time,
+                    SHRN_STRLEN(SLOG_InternalLevelNames[SLOG_LEVEL_WARN]) + 1 + count + sizeof(text) - 1);
+
+                encoding = SLOG_ENCODING_TEXT;
+                time = 0;
+            }
+
+            start = SLOG_InternalRenderLogBegin(out, encoding, SLOG_LEVEL_WARN, NULL, NULL, time);
+            SLOG_InternalBufferAppend(out, digits, count);
+            SLOG_InternalBufferAppend(out, text, sizeof(text) - 1);
+            SLOG_InternalRenderLogEnd(out, encoding, start, NULL, 0);
+        }
+
+        /*
+         * Write the records that are ready with one gathering write. Only
+         * called by the writer thread.
+         *
+         * Text records are written straight from the queue and handed back to
+         * producers after the write, deferred records are rendered into 'batch'.
+         * Logs dropped since the last call are reported first.
+         *
+         * Returns the number of records written.
+         */
+        size_t SLOG_InternalQueueDrain(SLOG_InternalQueue * queue, char * batch, size_t capacity)
+        {
+            SLOG_InternalIoVec iov[SLOG_INTERNAL_GATHER_MAX];
+
+            SLOG_InternalThreadState * state = SLOG_InternalArenaEnter();
+
+            FILE * file = SLOG_InternalEnterOutput();
+
+            size_t binaryFile = SLOG_INTERNAL_ATOMIC_LOAD(&SLOGBinaryFile);
+            size_t limit = SLOGFlushSize ? SLOGFlushSize : capacity;
+            size_t dropped = SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&SLOGAsync.Dropped);
+            size_t pos = queue->Tail;
+            size_t used = 0;
+            size_t size = 0;
+
+            int count = 0;
+            int scratched = 0;
+
+            if (dropped)
+            {
+                SLOG_InternalBuffer out;
+
+                out.Data = batch;
+                out.Size = 0;
+                out.Capacity = capacity;
+                out.Growable = 0;
+                out.Color = SLOGBinary ? 0 : SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
+
+                SLOG_InternalRenderDropped(&out, dropped);
+
+                SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGAsync.Dropped, (size_t)0 - dropped);
+
+                iov[0].iov_base = batch;
+                iov[0].iov_len = out.Size;
+                count = 1;
+
+                used = out.Size;
+            }
+
+            while (count < SLOG_INTERNAL_GATHER_MAX && size < limit && !scratched)
+            {
+                SLOG_InternalRecord * record = SLOG_InternalQueueAt(queue, pos);
+
+                char * data;
+                size_t length;
+
+                /*
+                 * The record is only ours once its sequence says so, read nothing else before.
+                 */
+                if (SLOG_INTERNAL_ATOMIC_LOAD(&record->Sequence) != pos + 1)
+                    break;
+
+                data = (char *)(record + 1);
+                length = record->Size;
+
+                if (record->Deferred)
+                {
+                    SLOG_InternalBuffer out;
+
+                    out.Data = batch + used;
+                    out.Size = 0;
+                    out.Capacity = capacity - used;
+                    out.Growable = 0;
+                    out.Color = SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
+
+                    SLOG_InternalRenderDeferred(&out, record, binaryFile);
+
+                    if (out.Size <= out.Capacity)
+                    {
+                        data = out.Data;
+                        length = out.Size;
+
+                        used += out.Size;
+                    }
+                    else if (count)
+                    {
+                        /*
+                         * Render it again at the start of the next batch.
+                         */
+                        break;
+                    }
+                    else
+                    {
+                        SLOG_InternalArenaBuffer(state, &out, out.Color, out.Size);
+
+                        SLOG_InternalRenderDeferred(&out, record, binaryFile);
+
+                        data = out.Data;
+                        length = out.Size;
+
+                        /*
+                         * Write the batch with the record before it takes more temporaries.
+                         */
+                        scratched = 1;
+                    }
+                }
+
+                if (count && (char *)iov[count - 1].iov_base + iov[count - 1].iov_len == data)
+                {
+                    iov[count - 1].iov_len += length;
+                }
+                else if (length)
+                {
+                    iov[count].iov_base = data;
+                    iov[count].iov_len = length;
+                    count++;
+                }
+
+                size += length;
+                pos++;
+            }
+
+            if (count)
+                SLOG_InternalOutputGather(file, iov, count);
+
+            SLOG_InternalLeaveOutput();
+
+            SLOG_InternalArenaLeave(state);
+
+            size = pos - queue->Tail;
+
+            /*
+             * Hand the written records back to producers.
+             */
+            for (pos = queue->Tail; pos != queue->Tail + size; pos++)
+                SLOG_INTERNAL_ATOMIC_STORE(&SLOG_InternalQueueAt(queue, pos)->Sequence, pos + queue->Mask + 1);
+
+            SLOG_INTERNAL_ATOMIC_STORE(&queue->Tail, pos);
+
+            /*
+             * Pairs with the fence in SLOG_InternalWaitForRoom.
+             */
+            SLOG_INTERNAL_ATOMIC_FENCE();
+
+            if (size && SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Waiting))
+            {
+                SLOG_InternalMutexLock(&SLOGAsync.Mutex);
+                SLOG_InternalCondBroadcast(&SLOGAsync.Room);
+                SLOG_InternalMutexUnlock(&SLOGAsync.Mutex);
+            }
+
+            return size;
+        }
+
+        SLOG_INTERNAL_THREAD_RESULT SLOG_InternalWriterMain(void * arg)
+        {
+            SLOG_InternalQueue * queue = &SLOGAsync.Queue;
+
+            (void)arg;
+
+            /*
+             * Deferred logs are rendered with the timestamp cache of this thread.
+             */
+            SLOG_InternalGetThreadState();
+
+            for (;;)
+            {
+                /*
+                 * Everything queued before 'Stop' was set gets written by the drain below.
+                 */
+                size_t stop = SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Stop);
+
+                while (SLOG_InternalQueueDrain(queue, SLOGAsync.Batch, SLOGAsync.BatchCapacity))
+                    ;
+
+                SLOG_InternalFlushOutput();
+
+                SLOG_InternalMutexLock(&SLOGAsync.Mutex);
+
+                SLOG_InternalCondBroadcast(&SLOGAsync.Drained);
+
+                if (stop)
+                {
+                    SLOG_InternalMutexUnlock(&SLOGAsync.Mutex);
+                    break;
+                }
+
+                if (SLOG_INTERNAL_ATOMIC_LOAD(&SLOG_InternalQueueAt(queue, queue->Tail)->Sequence) != queue->Tail + 1
+                    && !SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Stop))
+                    SLOG_InternalCondTimedWait(&SLOGAsync.Wake, &SLOGAsync.Mutex, SLOGAsync.FlushIntervalMs);
+
+                SLOG_InternalMutexUnlock(&SLOGAsync.Mutex);
+            }
+
+            return 0;
+        }
+
+        int SLOG_InternalAsyncStart(const SLOGConfig * config)
+        {
+            SLOG_InternalQueue * queue = &SLOGAsync.Queue;
+
+            size_t capacity = 1;
+            size_t i = 0;
+
+            while (capacity < config->QueueSize)
+                capacity <<= 1;
+
+            queue->Head = 0;
+            queue->Tail = 0;
+            queue->Mask = capacity - 1;
+            queue->RecordSize = config->RecordSize;
+
+            /*
+             * Deferred records, which binary logs always are, need room for the header on top of the captured arguments.
+             */
+            if ((config->Deferred || config->Binary) && queue->RecordSize < sizeof(SLOG_InternalDeferred))
+                queue->RecordSize = sizeof(SLOG_InternalDeferred);
+
+            queue->Stride = (sizeof(SLOG_InternalRecord) + queue->RecordSize + SLOG_INTERNAL_CACHE_LINE - 1)
+                & ~(size_t)(SLOG_INTERNAL_CACHE_LINE - 1);
+
+            queue->Memory = SHRN_MALLOC(capacity * queue->Stride + SLOG_INTERNAL_CACHE_LINE);
+
+            if (!queue->Memory)
+                return 0;
+
+            queue->Records = (char *)(((uintptr_t)queue->Memory + SLOG_INTERNAL_CACHE_LINE - 1)
+                & ~(uintptr_t)(SLOG_INTERNAL_CACHE_LINE - 1));
+
+            for (i = 0; i < capacity; i++)
+                SLOG_InternalQueueAt(queue, i)->Sequence = i;
+
+            SLOGAsync.BatchCapacity = queue->RecordSize > 65536 ? queue->RecordSize : 65536;
+            SLOGAsync.Batch = (char *)SHRN_MALLOC(SLOGAsync.BatchCapacity);
+
+            if (!SLOGAsync.Batch)
+            {
+                SHRN_FREE(queue->Memory);
+                return 0;
+            }
+
+            SLOGAsync.FlushIntervalMs = config->FlushIntervalMs;
+            SLOGAsync.Deferred = config->Deferred || config->Binary;
+            SLOGAsync.Waiting = 0;
+            SLOGAsync.Dropped = 0;
+            SLOGAsync.Stop = 0;
+
+            for (i = 0; i < SLOG_LEVEL_COUNT; i++)
+                SLOGAsync.FullPolicy[i] = config->FullPolicy[i];
+
+            SLOG_InternalMutexInit(&SLOGAsync.Mutex);
+            SLOG_InternalCondInit(&SLOGAsync.Wake);
+            SLOG_InternalCondInit(&SLOGAsync.Drained);
+            SLOG_InternalCondInit(&SLOGAsync.Room);
+
+            if (!SLOG_InternalThreadStart(&SLOGAsync.Writer, SLOG_InternalWriterMain, NULL))
+            {
+                SLOG_InternalCondDestroy(&SLOGAsync.Room);
+                SLOG_InternalCondDestroy(&SLOGAsync.Drained);
+                SLOG_InternalCondDestroy(&SLOGAsync.Wake);
+                SLOG_InternalMutexDestroy(&SLOGAsync.Mutex);
+
+                SHRN_FREE(SLOGAsync.Batch);
+                SHRN_FREE(queue->Memory);
+
+                return 0;
+            }
+
+            SLOG_INTERNAL_ATOMIC_STORE(&SLOGAsync.Running, 1);
+
+            return 1;
+        }
+
+        void SLOG_InternalAsyncStop()
+        {
+            SLOG_INTERNAL_ATOMIC_STORE(&SLOGAsync.Running, 0);
+            SLOG_INTERNAL_ATOMIC_STORE(&SLOGAsync.Stop, 1);
+
+            SLOG_InternalWakeWriter();
+            SLOG_InternalThreadJoin(SLOGAsync.Writer);
+
+            SLOG_InternalCondDestroy(&SLOGAsync.Room);
+            SLOG_InternalCondDestroy(&SLOGAsync.Drained);
+            SLOG_InternalCondDestroy(&SLOGAsync.Wake);
+            SLOG_InternalMutexDestroy(&SLOGAsync.Mutex);
+
+            SHRN_FREE(SLOGAsync.Batch);
+            SHRN_FREE(SLOGAsync.Queue.Memory);
+        }
+    #endif
+
+    /*
+     * Write a complete log line to the output file, through the writer thread when asynchronous.
+     */
+    void SLOG_InternalWrite(int level, const char * data, size_t size)
+    {
+        int flush = level >= SLOGFlushLevel;
+
+    #ifndef SLOG_NO_THREADS
+        if (SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Running))
+        {
+            if (SLOG_InternalQueuePush(&SLOGAsync.Queue, level, data, size))
+            {
+                if (flush)
+                    SLOGFlush();
+
+                return;
+            }
+
+            /*
+             * Too large for the queue, write it after the logs queued before
+             * it and before the writer thread writes any later ones.
+             */
+            SLOGFlush();
+
+            flush = 1;
+        }
+    #endif
+
+        SLOG_InternalOutputLog(SLOG_InternalEnterOutput(), data, size, flush);
+        SLOG_InternalLeaveOutput();
+    }
+
+    void SLOGGetDefaultConfig(SLOGConfig * config)
+    {
+        int i;
+
+        config->Async = 0;
+        config->QueueSize = 4096;
+        config->RecordSize = 256;
+        config->FlushIntervalMs = 10;
+        config->Deferred = 0;
+        config->Binary = 0;
+        config->FlushSize = 0;
+        config->FlushLevel = SLOG_LEVEL_ERROR;
+
+        for (i = 0; i < SLOG_LEVEL_COUNT; i++)
+            config->FullPolicy[i] = SLOG_FULL_BLOCK;
+
+        config->Clock = SLOG_CLOCK_REALTIME;
+        config->Encoding = SLOG_ENCODING_TEXT;
+        config->ArenaSize = 16384;
+        config->Preallocate = 0;
+        config->Threads = 64;
+        config->SiteMemory = 1 << 20;
+        config->TimestampDigits = -1;
+    }
+
+    /*
+     * Milliseconds of a coarse monotonic clock, only used for the intervals of rate limited call sites.
+     */
+    size_t SLOG_InternalNowMs()
+    {
+    #ifdef _WIN32
+        return (size_t)GetTickCount64();
+    #else
+        struct timespec time;
+
+        #ifdef CLOCK_MONOTONIC_COARSE
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+        #else
+            clock_gettime(CLOCK_MONOTONIC, &time);
+        #endif
+
+        return (size_t)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+    #endif
+    }
+
+    /*
+     * Rate limited call sites that suppressed logs at least once.
+     */
+    static SLOGRateLimit * SLOGRateLimits = NULL;
+
+    /*
+     * Start a new interval of 'site' at 'now' unless another thread did
+     * already, and write how many logs were suppressed in the previous one.
+     */
+    void SLOG_InternalRateRestart(SLOGRateLimit * site, size_t start, size_t now, size_t limit)
+    {
+        char msg[512];
+
+        size_t count;
+
+        if (!SLOG_INTERNAL_ATOMIC_CAS(&site->Start, &start, now))
+            return;
+
+        count = SLOG_INTERNAL_ATOMIC_LOAD(&site->Count);
+
+        SLOG_INTERNAL_ATOMIC_FETCH_ADD(&site->Count, (size_t)0 - count);
+
+        if (count > limit)
+        {
+            const SLOGSite * meta = site->Site;
+
+            SLOGFormatTo(msg, sizeof(msg), "Log at %s:%d in %s suppressed %zu times.\n", meta->File, meta->Line, meta->Function, count - limit);
+
+            SLOGLog(meta->Level, SLOG_InternalLevelNames[meta->Level < SLOG_LEVEL_TRACE ? SLOG_LEVEL_TRACE
+                : meta->Level > SLOG_LEVEL_FATAL ? SLOG_LEVEL_FATAL : meta->Level], msg);
+        }
+    }
+
+    int SLOGRateLimited(SLOGRateLimit * site, size_t limit, unsigned intervalMs)
+    {
+        size_t now = SLOG_InternalNowMs();
+        size_t start = SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&site->Start);
+        size_t count;
+        size_t listed = 0;
+
+        if (now - start >= intervalMs)
+            SLOG_InternalRateRestart(site, start, now, limit);
+
+        count = SLOG_INTERNAL_ATOMIC_FETCH_ADD(&site->Count, 1);
+
+        if (count < limit)
+            return 0;
+
+        /*
+         * List the site on its first suppressed log, so the summary is written
+         * even if the site doesn't log again.
+         */
+        if (count == limit && SLOG_INTERNAL_ATOMIC_CAS(&site->Listed, &listed, 1))
+        {
+            SLOGRateLimit * head = (SLOGRateLimit *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGRateLimits);
+
+            site->Limit = limit;
+            site->IntervalMs = intervalMs;
+
+            do
+                site->Next = head;
+            while (!SLOG_INTERNAL_ATOMIC_CAS_PTR(&SLOGRateLimits, &head, site));
+        }
+
+        return 1;
+    }
+
+    /*
+     * Write the summaries of listed sites whose interval ended, or of every listed site if 'all' is set.
+     */
+    void SLOG_InternalRateSweep(int all)
+    {
+        SLOGRateLimit * site = (SLOGRateLimit *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGRateLimits);
+
+        size_t now = site ? SLOG_InternalNowMs() : 0;
+
+        for (; site; site = site->Next)
+        {
+            size_t start = SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&site->Start);
+
+            if (all || now - start >= site->IntervalMs)
+                SLOG_InternalRateRestart(site, start, now, site->Limit);
+        }
+    }
+
+    void SLOGFlush()
+    {
+        SLOG_InternalRateSweep(0);
+
+    #ifndef SLOG_NO_THREADS
+        if (SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Running))
+        {
+            size_t target = SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Queue.Head);
+
+            SLOG_InternalMutexLock(&SLOGAsync.Mutex);
+
+            while ((ptrdiff_t)(SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Queue.Tail) - target) < 0)
+            {
+                SLOG_InternalCondSignal(&SLOGAsync.Wake);
+                SLOG_InternalCondWait(&SLOGAsync.Drained, &SLOGAsync.Mutex);
+            }
+
+            SLOG_InternalMutexUnlock(&SLOGAsync.Mutex);
+
+            return;
+        }
+    #endif
+
+        SLOG_InternalFlushOutput();
+    }
+
+    void SLOGShutdown()
+    {
+        SLOG_InternalRateSweep(1);
+
+    #ifndef SLOG_NO_THREADS
+        if (SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Running))
+            SLOG_InternalAsyncStop();
+    #endif
+
+        SLOG_InternalFlushOutput();
+    }
+
+    #ifdef _WIN32
+        static void InitializeWin32Console()
+        {
+            HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+
+            DWORD consoleMode = 0;
+
+            GetConsoleMode(hConsole, &consoleMode);
+
+            if (!(consoleMode & ENABLE_VIRTUAL_TERMINAL_PROCESSING))
+            {
+                consoleMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+                SetConsoleMode(hConsole, consoleMode);
+            }
+        }
+    #endif
+
+    void SLOGInit()
+    {
+        SLOGConfig config;
+
+        SLOGGetDefaultConfig(&config);
+        SLOGInitWithConfig(&config);
+    }
+
+    /*
+     * Allocate the call site memory and thread states of SLOGConfig::Preallocate.
+     * The call site memory is kept from the first call, thread states are
+     * added up to 'config->Threads'.
+     */
+    void SLOG_InternalPreallocate(const SLOGConfig * config)
+    {
+        SLOG_InternalThreadState * state;
+
+        if (!SLOGSiteMemory && config->SiteMemory)
+        {
+            SLOGSiteMemory = (char *)SHRN_MALLOC(config->SiteMemory);
+            SLOGSiteMemorySize = SLOGSiteMemory ? config->SiteMemory : 0;
+
+            SLOGPreallocatedBytes += SLOGSiteMemorySize;
+        }
+
+        SLOG_INTERNAL_LOCK_POOL();
+
+        /*
+         * Give unused states arenas of the new SLOGConfig::ArenaSize, states
+         * in use get them with their next log.
+         */
+        for (state = SLOGStatePool.Free; state; state = state->Next)
+        {
+            if (state->ArenaSize == SLOGArenaSize)
+                continue;
+
+            SLOGPreallocatedBytes -= state->ArenaSize;
+
+            SHRN_FREE(state->Arena);
+
+            state->Arena = SLOGArenaSize ? (char *)SHRN_MALLOC(SLOGArenaSize) : NULL;
+            state->ArenaSize = state->Arena ? SLOGArenaSize : 0;
+
+            SLOGPreallocatedBytes += state->ArenaSize;
+        }
+
+        while (SLOGStatePool.Count < config->Threads)
+        {
+            state = (SLOG_InternalThreadState *)SHRN_MALLOC(sizeof(SLOG_InternalThreadState));
+
+            if (!state)
+                break;
+
+            SHRN_MEMSET(state, 0, sizeof(SLOG_InternalThreadState));
+
+            state->Arena = SLOGArenaSize ? (char *)SHRN_MALLOC(SLOGArenaSize) : NULL;
+            state->ArenaSize = state->Arena ? SLOGArenaSize : 0;
+            state->Pooled = 1;
+            state->Next = SLOGStatePool.Free;
+
+            SLOG_INTERNAL_ATOMIC_STORE_PTR(&SLOGStatePool.Free, state);
+            SLOGStatePool.Count++;
+
+            SLOGPreallocatedBytes += sizeof(SLOG_InternalThreadState) + state->ArenaSize;
+        }
+
+        SLOG_INTERNAL_UNLOCK_POOL();
+    }
+
+    void SLOGInitWithConfig(const SLOGConfig * config)
+    {
+        static int registered = 0;
+
+        SLOGShutdown();
+
+        /*
+         * Make sure queued and buffered logs are written when the program exits.
+         */
+        if (!registered)
+        {
+        #ifndef SLOG_NO_THREADS
+            SLOG_InternalMutexInit(&SLOGPending.Mutex);
+            SLOG_InternalMutexInit(&SLOGStatePool.Mutex);
+        #endif
+
+            atexit(SLOGShutdown);
+            registered = 1;
+        }
+
+        SLOGBinary = config->Binary;
+
+        SLOGClockSource = config->Clock;
+        SLOGTimestampDigits = config->TimestampDigits;
+        SLOGFileEncoding = config->Encoding >= 0 && config->Encoding < SLOG_INTERNAL_ENCODINGS ? config->Encoding : SLOG_ENCODING_TEXT;
+
+        if (SLOGClockSource == SLOG_CLOCK_TSC && !SLOGTscPerSecond)
+            SLOG_InternalCalibrateTsc();
+
+        SLOGFlushLevel = config->FlushLevel;
+        SLOGFlushInterval = (uint64_t)config->FlushIntervalMs * 1000000;
+        SLOGArenaSize = config->ArenaSize;
+
+        if (config->FlushSize != SLOGFlushSize)
+        {
+            SHRN_FREE(SLOGPending.Data);
+
+            SLOGPending.Data = config->FlushSize ? (char *)SHRN_MALLOC(config->FlushSize) : NULL;
+            SLOGFlushSize = SLOGPending.Data ? config->FlushSize : 0;
+        }
+
+        if (SLOGBinary)
+            SLOG_InternalBinaryBegin(stdout);
+
+        SLOG_InternalSwapOutput(stdout);
+
+        SLOG_InternalUpdateColor();
+
+    #ifdef _WIN32
+        InitializeWin32Console();
+    #endif
+
+        if (config->Preallocate)
+            SLOG_InternalPreallocate(config);
+
+        SLOG_INTERNAL_ATOMIC_STORE(&SLOGAllocations, 0);
+        SLOG_INTERNAL_ATOMIC_STORE(&SLOGAllocatedBytes, 0);
+
+        SLOGPreallocate = config->Preallocate;
+
+    #ifndef SLOG_NO_THREADS
+        if (config->Async)
+            SLOG_InternalAsyncStart(config);
+    #endif
+    }
+
+    void SLOGGetStats(SLOGStats * stats)
+    {
+        stats->Allocations = SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAllocations);
+        stats->AllocatedBytes = SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAllocatedBytes);
+        stats->PreallocatedBytes = SLOGPreallocatedBytes;
+    }
+
+    void SLOGSetLogFilterLevel(int level)
+    {
+        SLOG_INTERNAL_ATOMIC_STORE_INT(&SLOGLogFilterLevel, level);
+
+        SLOG_InternalUpdateEnabledLevel();
+    }
+
+    void SLOGSetOutputFile(FILE * f)
+    {
+        if (f)
+        {
+            FILE * previous = (FILE *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGOutFile);
+
+            SLOGFlush();
+
+            if (SLOGBinary)
+                SLOG_InternalBinaryBegin(f);
+
+            SLOG_InternalSwapOutput(f);
+
+            /*
+             * Other threads may have written to the previous file after the flush.
+             */
+            if (previous && previous != f)
+            {
+                if (SLOGFlushSize)
+                    SLOG_InternalFlushPending();
+
+                fflush(previous);
+            }
+
+            SLOG_InternalUpdateColor();
+        }
+    }
+
+    void SLOGSetColorMode(int mode)
+    {
+        SLOGColorMode = mode;
+
+        SLOG_InternalUpdateColor();
+    }
+
+    int SLOGAddSink(const SLOGSink * sink)
+    {
+        int i;
+
+        for (i = 0; i < SLOG_MAX_SINKS; i++)
+        {
+            size_t unused = 0;
+
+            if (SLOG_INTERNAL_ATOMIC_CAS(&SLOGSinks[i].Used, &unused, 1))
+            {
+                SLOGSinks[i].Sink.Write = sink->Write;
+                SLOGSinks[i].Sink.User = sink->User;
+                SLOGSinks[i].Sink.Color = sink->Color;
+                SLOGSinks[i].Sink.Encoding = sink->Encoding >= 0 && sink->Encoding < SLOG_INTERNAL_ENCODINGS ? sink->Encoding : SLOG_ENCODING_TEXT;
+
+                /*
+                 * Publish the sink to logging threads.
+                 */
+                SLOG_INTERNAL_ATOMIC_STORE(&SLOGSinks[i].Sink.Levels, sink->Levels);
+
+                SLOG_InternalUpdateSinkLevels();
+
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    void SLOGRemoveSink(int sink)
+    {
+        if (sink < 0 || sink >= SLOG_MAX_SINKS)
+            return;
+
+        SLOG_INTERNAL_ATOMIC_STORE(&SLOGSinks[sink].Sink.Levels, 0);
+
+        SLOG_InternalUpdateSinkLevels();
+
+        SLOG_INTERNAL_ATOMIC_STORE(&SLOGSinks[sink].Used, 0);
+    }
+
+    void SLOGSinkWriteFile(void * user, int level, const char * data, size_t size)
+    {
+        (void)level;
+
+        fwrite(data, 1, size, (FILE *)user);
+    }
+
+    /*
+     * A preallocated and memory mapped file of a SLOGMapSink.
+     *
+     * Writers reserve bytes by adding to 'Reserved' and add them to
+     * 'Committed' once copied. The writer whose reservation crosses 'Size'
+     * sets 'End' to where it starts, the logs of the segment end there, and
+     * opens the next segment. 'Failed' is set if that didn't work.
+     */
+    typedef struct SLOG_InternalSegment
+    {
+        char * Data;
+        size_t Size;
+        size_t Reserved;
+        size_t Committed;
+        size_t End;
+        size_t Failed;
+    #ifdef _WIN32
+        HANDLE File;
+        HANDLE Mapping;
+    #else
+        int File;
+    #endif
+        struct SLOG_InternalSegment * Previous;
+    } SLOG_InternalSegment;
+
+    struct SLOGMapSink
+    {
+        char * Path;
+        size_t PathSize;
+        size_t SegmentSize;
+        size_t Segments;
+        /*
+         * Writers may still look at full segments, so they are only freed
+         * by SLOGCloseMapSink. Only the writer that filled the current
+         * segment opens the next one, no lock is needed for that.
+         */
+        SLOG_InternalSegment * Current;
+    };
+
+    /*
+     * Create, preallocate and map the next segment of 'sink'.
+     *
+     * Returns NULL if that didn't work.
+     */
+    SLOG_InternalSegment * SLOG_InternalOpenSegment(SLOGMapSink * sink)
+    {
+        SLOG_InternalSegment * segment = (SLOG_InternalSegment *)SHRN_MALLOC(sizeof(SLOG_InternalSegment));
+
+        char * name = (char *)SHRN_MALLOC(sink->PathSize + 32);
+
+        if (!segment || !name)
+        {
+            SHRN_FREE(name);
+            SHRN_FREE(segment);
+
+            return NULL;
+        }
+
+        SLOGFormatTo(name, sink->PathSize + 32, "%s.%zu", sink->Path, sink->Segments);
+
+        segment->Data = NULL;
+        segment->Size = sink->SegmentSize;
+        segment->Reserved = 0;
+        segment->Committed = 0;
+        segment->End = 0;
+        segment->Failed = 0;
+        segment->Previous = sink->Current;
+
+    #ifdef _WIN32
+        segment->File = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        segment->Mapping = NULL;
+
+        if (segment->File != INVALID_HANDLE_VALUE)
+        {
+            segment->Mapping = CreateFileMappingA(segment->File, NULL, PAGE_READWRITE,
+                (DWORD)((uint64_t)segment->Size >> 32), (DWORD)segment->Size, NULL);
+
+            if (segment->Mapping)
+                segment->Data = (char *)MapViewOfFile(segment->Mapping, FILE_MAP_WRITE, 0, 0, segment->Size);
+        }
+
+        if (!segment->Data)
+        {
+            if (segment->Mapping)
+                CloseHandle(segment->Mapping);
+
+            if (segment->File != INVALID_HANDLE_VALUE)
+                CloseHandle(segment->File);
+        }
+    #else
+        segment->File = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (segment->File >= 0)
+        {
+        #ifdef __linux__
+            int allocated = posix_fallocate(segment->File, 0, (off_t)segment->Size) == 0;
+        #else
+            int allocated = ftruncate(segment->File, (off_t)segment->Size) == 0;
+        #endif
+
+            if (allocated)
+            {
+                void * data = mmap(NULL, segment->Size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->File, 0);
+
+                if (data != MAP_FAILED)
+                    segment->Data = (char *)data;
+            }
+
+            if (!segment->Data)
+                close(segment->File);
+        }
+    #endif
+
+        SHRN_FREE(name);
+
+        if (!segment->Data)
+        {
+            SHRN_FREE(segment);
+            return NULL;
+        }
+
+        sink->Segments++;
+
+        return segment;
+    }
+
+    /*
+     * Unmap 'segment' once every reserved log is copied and cut it to them.
+     */
+    void SLOG_InternalCloseSegment(SLOG_InternalSegment * segment)
+    {
+        size_t end = SLOG_INTERNAL_ATOMIC_LOAD(&segment->End);
+
+    #ifndef SLOG_NO_THREADS
+        while (SLOG_INTERNAL_ATOMIC_LOAD(&segment->Committed) != end)
+            SLOG_InternalYield();
+    #endif
+
+    #ifdef _WIN32
+        {
+            LARGE_INTEGER size;
+
+            size.QuadPart = (LONGLONG)end;
+
+            UnmapViewOfFile(segment->Data);
+            CloseHandle(segment->Mapping);
+
+            SetFilePointerEx(segment->File, size, NULL, FILE_BEGIN);
+            SetEndOfFile(segment->File);
+            CloseHandle(segment->File);
+        }
+    #else
+        munmap(segment->Data, segment->Size);
+
+        if (ftruncate(segment->File, (off_t)end))
+        {
+            /* The segment keeps its zero bytes after 'end'. */
+        }
+
+        close(segment->File);
+    #endif
+
+        segment->Data = NULL;
+    }
+
+    SLOGMapSink * SLOGOpenMapSink(const char * path, size_t segmentSize)
+    {
+        SLOGMapSink * sink = (SLOGMapSink *)SHRN_MALLOC(sizeof(SLOGMapSink));
+
+        if (!sink)
+            return NULL;
+
+        sink->PathSize = SHRN_STRLEN(path);
+        sink->Path = (char *)SHRN_MALLOC(sink->PathSize + 1);
+        sink->SegmentSize = segmentSize;
+        sink->Segments = 0;
+        sink->Current = NULL;
+
+        if (!sink->Path)
+        {
+            SHRN_FREE(sink);
+            return NULL;
+        }
+
+        SHRN_MEMCPY(sink->Path, path, sink->PathSize + 1);
+
+        sink->Current = segmentSize ? SLOG_InternalOpenSegment(sink) : NULL;
+
+        if (!sink->Current)
+        {
+            SHRN_FREE(sink->Path);
+            SHRN_FREE(sink);
+
+            return NULL;
+        }
+
+        return sink;
+    }
+
+    void SLOGCloseMapSink(SLOGMapSink * sink)
+    {
+        SLOG_InternalSegment * segment = sink->Current;
+
+        /*
+         * 'End' is only set yet if the next segment couldn't be opened.
+         */
+        if (segment->Reserved <= segment->Size)
+            segment->End = segment->Reserved;
+
+        SLOG_InternalCloseSegment(segment);
+
+        while (segment)
+        {
+            SLOG_InternalSegment * previous = segment->Previous;
+
+            SHRN_FREE(segment);
+
+            segment = previous;
+        }
+
+        SHRN_FREE(sink->Path);
+        SHRN_FREE(sink);
+    }
+
+    void SLOGMapSinkWrite(void * user, int level, const char * data, size_t size)
+    {
+        SLOGMapSink * sink = (SLOGMapSink *)user;
+
+        (void)level;
+
+        if (size > sink->SegmentSize)
+            return;
+
+        for (;;)
+        {
+            SLOG_InternalSegment * segment = (SLOG_InternalSegment *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&sink->Current);
+
+            size_t pos = SLOG_INTERNAL_ATOMIC_FETCH_ADD(&segment->Reserved, size);
+
+            SLOG_InternalSegment * next;
+
+            if (pos + size <= segment->Size)
+            {
+                SHRN_MEMCPY(segment->Data + pos, data, size);
+
+                SLOG_INTERNAL_ATOMIC_FETCH_ADD(&segment->Committed, size);
+
+                return;
+            }
+
+            if (pos > segment->Size)
+            {
+                /*
+                 * Another writer is moving to the next segment.
+                 */
+                while (SLOG_INTERNAL_ATOMIC_LOAD_PTR(&sink->Current) == segment)
+                {
+                    if (SLOG_INTERNAL_ATOMIC_LOAD(&segment->Failed))
+                        return;
+
+                #ifndef SLOG_NO_THREADS
+                    SLOG_InternalYield();
+                #endif
+                }
+
+                continue;
+            }
+
+            /*
+             * This reservation crossed the end, the segment ends where it starts.
+             */
+            SLOG_INTERNAL_ATOMIC_STORE(&segment->End, pos);
+
+            next = SLOG_InternalOpenSegment(sink);
+
+            if (!next)
+            {
+                /*
+                 * Logs are dropped from now on.
+                 */
+                SLOG_INTERNAL_ATOMIC_STORE(&segment->Failed, 1);
+                return;
+            }
+
+            SLOG_INTERNAL_ATOMIC_STORE_PTR(&sink->Current, next);
+
+            SLOG_InternalCloseSegment(segment);
+        }
+    }
+
+    /*
+     * Files appended to by SLOGRotatingSink, written with a single unbuffered write per log.
+     */
+    #ifdef _WIN32
+        typedef HANDLE SLOG_InternalFd;
+
+        #define SLOG_INTERNAL_NO_FD INVALID_HANDLE_VALUE
+
+        SLOG_InternalFd SLOG_InternalOpenAppend(const char * path)
+        {
+            return CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        }
+
+        size_t SLOG_InternalFdSize(SLOG_InternalFd fd)
+        {
+            LARGE_INTEGER size;
+
+            return GetFileSizeEx(fd, &size) ? (size_t)size.QuadPart : 0;
+        }
+
+        void SLOG_InternalFdWrite(SLOG_InternalFd fd, const char * data, size_t size)
+        {
+            DWORD written;
+
+            while (size && WriteFile(fd, data, (DWORD)size, &written, NULL))
+            {
+                data += written;
+                size -= written;
+            }
+        }
+
+        #define SLOG_InternalFdClose(fd)         CloseHandle(fd)
+        #define SLOG_InternalRename(from, to)    MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING)
+        #define SLOG_InternalRemove(path)        DeleteFileA(path)
+        #define SLOG_InternalExists(path)        (GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES)
+    #else
+        typedef int SLOG_InternalFd;
+
+        #define SLOG_INTERNAL_NO_FD -1
+
+        #define SLOG_InternalOpenAppend(path) open(path, O_WRONLY | O_CREAT | O_APPEND, 0644)
+        #define SLOG_InternalFdSize(fd)       ((size_t)lseek(fd, 0, SEEK_END))
+
+        void SLOG_InternalFdWrite(SLOG_InternalFd fd, const char * data, size_t size)
+        {
+            while (size)
+            {
+                ssize_t written = write(fd, data, size);
+
+                if (written < 0 && errno == EINTR)
+                    continue;
+
+                if (written <= 0)
+                    break;
+
+                data += written;
+                size -= written;
+            }
+        }
+
+        #define SLOG_InternalFdClose(fd)         close(fd)
+        #define SLOG_InternalRename(from, to)    rename(from, to)
+        #define SLOG_InternalRemove(path)        unlink(path)
+        #define SLOG_InternalExists(path)        (access(path, F_OK) == 0)
+    #endif
+
+    /*
+     * An open file of a SLOGRotatingSink. 'Users' counts the writers using 'Fd'.
+     */
+    typedef struct SLOG_InternalRotatingFile
+    {
+        SLOG_InternalFd Fd;
+        size_t Size;
+        size_t Users;
+    } SLOG_InternalRotatingFile;
+
+    struct SLOGRotatingSink
+    {
+        /*
+         * 'Current' points to one of 'Files', a rotation opens the other one
+         * and closes the previous file once its writers are done.
+         */
+        SLOG_InternalRotatingFile Files[2];
+        SLOG_InternalRotatingFile * Current;
+        SLOGRotation Rotation;
+        char * Path;
+        char * Name;        /* Room for the names of rotated files. */
+        size_t NameSize;
+        unsigned Rotated;   /* Number of rotated files that exist. */
+        uint64_t Deadline;  /* Time of the next rotation by time. */
+        size_t Requested;   /* Set when the file should be rotated. */
+    #ifndef SLOG_NO_THREADS
+        SLOG_InternalThread Rotator;
+        SLOG_InternalMutex Mutex;
+        SLOG_InternalCond Wake;
+        size_t Stop;
+    #endif
+    };
+
+    /*
+     * Time of the first multiple of the rotation interval after 'now'.
+     */
+    uint64_t SLOG_InternalNextRotation(const SLOGRotatingSink * sink, uint64_t now)
+    {
+        uint64_t interval = (uint64_t)sink->Rotation.Interval * 1000000000;
+
+        return interval ? (now / interval + 1) * interval : (uint64_t)-1;
+    }
+
+    /*
+     * Shift the rotated files, move the file to '.1' and switch writers to a
+     * new file. Only called by one thread at a time.
+     */
+    void SLOG_InternalRotate(SLOGRotatingSink * sink)
+    {
+        SLOG_InternalRotatingFile * previous = sink->Current;
+        SLOG_InternalRotatingFile * next = &sink->Files[previous == &sink->Files[0]];
+
+        unsigned i;
+
+        if (sink->Rotated < sink->Rotation.MaxFiles)
+            sink->Rotated++;
+
+        for (i = sink->Rotated; i > 1; i--)
+        {
+            char * from = sink->Name + sink->NameSize / 2;
+
+            SLOGFormatTo(from, sink->NameSize / 2, "%s.%u", sink->Path, i - 1);
+            SLOGFormatTo(sink->Name, sink->NameSize / 2, "%s.%u", sink->Path, i);
+
+            SLOG_InternalRename(from, sink->Name);
+        }
+
+        if (sink->Rotation.MaxFiles)
+        {
+            SLOGFormatTo(sink->Name, sink->NameSize / 2, "%s.1", sink->Path);
+
+            SLOG_InternalRename(sink->Path, sink->Name);
+        }
+        else
+        {
+            SLOG_InternalRemove(sink->Path);
+        }
+
+        /*
+         * Writers keep appending to the renamed file until the new one is published.
+         */
+        next->Fd = SLOG_InternalOpenAppend(sink->Path);
+
+        if (next->Fd == SLOG_INTERNAL_NO_FD)
+            return;
+
+        next->Size = 0;
+
+        SLOG_INTERNAL_ATOMIC_STORE_PTR(&sink->Current, next);
+
+    #ifndef SLOG_NO_THREADS
+        while (SLOG_INTERNAL_ATOMIC_FETCH_ADD(&previous->Users, 0))
+            SLOG_InternalYield();
+    #endif
+
+        SLOG_InternalFdClose(previous->Fd);
+    }
+
+    #ifndef SLOG_NO_THREADS
+        SLOG_INTERNAL_THREAD_RESULT SLOG_InternalRotatorMain(void * arg)
+        {
+            SLOGRotatingSink * sink = (SLOGRotatingSink *)arg;
+
+            for (;;)
+            {
+                uint64_t now = SLOG_InternalNow();
+
+                int rotate;
+
+                SLOG_InternalMutexLock(&sink->Mutex);
+
+                if (!SLOG_INTERNAL_ATOMIC_LOAD(&sink->Requested) && !SLOG_INTERNAL_ATOMIC_LOAD(&sink->Stop) && now < sink->Deadline)
+                {
+                    uint64_t wait = (sink->Deadline - now) / 1000000 + 1;
+
+                    SLOG_InternalCondTimedWait(&sink->Wake, &sink->Mutex, wait < 1000 ? (unsigned)wait : 1000);
+                }
+
+                SLOG_InternalMutexUnlock(&sink->Mutex);
+
+                if (SLOG_INTERNAL_ATOMIC_LOAD(&sink->Stop))
+                    break;
+
+                now = SLOG_InternalNow();
+
+                rotate = SLOG_INTERNAL_ATOMIC_LOAD(&sink->Requested) || now >= sink->Deadline;
+
+                if (rotate)
+                {
+                    SLOG_INTERNAL_ATOMIC_STORE(&sink->Requested, 0);
+
+                    SLOG_InternalRotate(sink);
+
+                    sink->Deadline = SLOG_InternalNextRotation(sink, now);
+                }
+            }
+
+            return 0;
+        }
+    #endif
+
+    SLOGRotatingSink * SLOGOpenRotatingSink(const char * path, const SLOGRotation * rotation)
+    {
+        SLOGRotatingSink * sink = (SLOGRotatingSink *)SHRN_MALLOC(sizeof(SLOGRotatingSink));
+
+        size_t pathSize = SHRN_STRLEN(path);
+
+        if (!sink)
+            return NULL;
+
+        /*
+         * Two names with a 32-bit suffix each.
+         */
+        sink->NameSize = 2 * (pathSize + 16);
+        sink->Name = (char *)SHRN_MALLOC(sink->NameSize);
+        sink->Path = (char *)SHRN_MALLOC(pathSize + 1);
+
+        sink->Files[0].Fd = sink->Name && sink->Path ? SLOG_InternalOpenAppend(path) : SLOG_INTERNAL_NO_FD;
+
+        if (sink->Files[0].Fd == SLOG_INTERNAL_NO_FD)
+        {
+            SHRN_FREE(sink->Name);
+            SHRN_FREE(sink->Path);
+            SHRN_FREE(sink);
+
+            return NULL;
+        }
+
+        SHRN_MEMCPY(sink->Path, path, pathSize + 1);
+
+        sink->Files[0].Size = SLOG_InternalFdSize(sink->Files[0].Fd);
+        sink->Files[0].Users = 0;
+        sink->Files[1].Fd = SLOG_INTERNAL_NO_FD;
+        sink->Files[1].Size = 0;
+        sink->Files[1].Users = 0;
+
+        sink->Current = &sink->Files[0];
+        sink->Rotation = *rotation;
+        sink->Requested = 0;
+
+        sink->Deadline = SLOG_InternalNextRotation(sink, SLOG_InternalNow());
+
+        /*
+         * Only shift the rotated files that are there.
+         */
+        for (sink->Rotated = 0; sink->Rotated < sink->Rotation.MaxFiles; sink->Rotated++)
+        {
+            SLOGFormatTo(sink->Name, sink->NameSize / 2, "%s.%u", sink->Path, sink->Rotated + 1);
+
+            if (!SLOG_InternalExists(sink->Name))
+                break;
+        }
+
+    #ifndef SLOG_NO_THREADS
+        sink->Stop = 0;
+
+        SLOG_InternalMutexInit(&sink->Mutex);
+        SLOG_InternalCondInit(&sink->Wake);
+
+        if (!SLOG_InternalThreadStart(&sink->Rotator, SLOG_InternalRotatorMain, sink))
+        {
+            SLOG_InternalCondDestroy(&sink->Wake);
+            SLOG_InternalMutexDestroy(&sink->Mutex);
+
+            SLOG_InternalFdClose(sink->Files[0].Fd);
+
+            SHRN_FREE(sink->Name);
+            SHRN_FREE(sink->Path);
+            SHRN_FREE(sink);
+
+            return NULL;
+        }
+    #endif
+
+        return sink;
+    }
+
+    void SLOGCloseRotatingSink(SLOGRotatingSink * sink)
+    {
+    #ifndef SLOG_NO_THREADS
+        SLOG_INTERNAL_ATOMIC_STORE(&sink->Stop, 1);
+
+        SLOG_InternalMutexLock(&sink->Mutex);
+        SLOG_InternalCondSignal(&sink->Wake);
+        SLOG_InternalMutexUnlock(&sink->Mutex);
+
+        SLOG_InternalThreadJoin(sink->Rotator);
+
+        SLOG_InternalCondDestroy(&sink->Wake);
+        SLOG_InternalMutexDestroy(&sink->Mutex);
+    #endif
+
+        SLOG_InternalFdClose(sink->Current->Fd);
+
+        SHRN_FREE(sink->Name);
+        SHRN_FREE(sink->Path);
+        SHRN_FREE(sink);
+    }
+
+    void SLOGRotateSink(SLOGRotatingSink * sink)
+    {
+    #ifndef SLOG_NO_THREADS
+        SLOG_INTERNAL_ATOMIC_STORE(&sink->Requested, 1);
+
+        SLOG_InternalMutexLock(&sink->Mutex);
+        SLOG_InternalCondSignal(&sink->Wake);
+        SLOG_InternalMutexUnlock(&sink->Mutex);
+    #else
+        SLOG_InternalRotate(sink);
+    #endif
+    }
+
+    void SLOGRotatingSinkWrite(void * user, int level, const char * data, size_t size)
+    {
+        SLOGRotatingSink * sink = (SLOGRotatingSink *)user;
+        SLOG_InternalRotatingFile * file;
+
+        size_t previous;
+        size_t maxSize = sink->Rotation.MaxSize;
+
+        (void)level;
+
+        /*
+         * Use the current file, unless it was replaced before this writer was counted.
+         */
+        for (;;)
+        {
+            file = (SLOG_InternalRotatingFile *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&sink->Current);
+
+            SLOG_INTERNAL_ATOMIC_FETCH_ADD(&file->Users, 1);
+
+            if (SLOG_INTERNAL_ATOMIC_LOAD_PTR(&sink->Current) == file)
+                break;
+
+            SLOG_INTERNAL_ATOMIC_FETCH_ADD(&file->Users, (size_t)-1);
+        }
+
+        previous = SLOG_INTERNAL_ATOMIC_FETCH_ADD(&file->Size, size);
+
+        SLOG_InternalFdWrite(file->Fd, data, size);
+
+        SLOG_INTERNAL_ATOMIC_FETCH_ADD(&file->Users, (size_t)-1);
+
+        /*
+         * Only the write that reaches the maximum size asks for a rotation.
+         */
+        if (maxSize && previous < maxSize && previous + size >= maxSize)
+            SLOGRotateSink(sink);
+
+    #ifdef SLOG_NO_THREADS
+        if (sink->Rotation.Interval && SLOG_InternalNow() >= sink->Deadline)
+        {
+            SLOG_InternalRotate(sink);
+
+            sink->Deadline = SLOG_InternalNextRotation(sink, SLOG_InternalNow());
+        }
+    #endif
+    }
+
+    /*
+     * Syslog sinks collect datagrams into batches, and send up to
+     * SLOG_INTERNAL_SYSLOG_BATCH of them at once.
+     */
+    #define SLOG_INTERNAL_SYSLOG_BATCH    64
+    #define SLOG_INTERNAL_SYSLOG_MAX      8192
+    #define SLOG_INTERNAL_SYSLOG_BUFFER   65536
+    #define SLOG_INTERNAL_SYSLOG_RETRY_MS 1000
+
+    /*
+     * Only the sender thread waits for the daemon to make room, a logging thread sending without threads doesn't.
+     */
+    #ifdef SLOG_NO_THREADS
+        #define SLOG_INTERNAL_SYSLOG_WAIT_MS 0
+    #else
+        #define SLOG_INTERNAL_SYSLOG_WAIT_MS 100
+    #endif
+
+    #ifndef _WIN32
+        /*
+         * sendmmsg is declared with _GNU_SOURCE, and reached through syscall
+         * on Linux otherwise. Elsewhere datagrams are sent one at a time.
+         */
+        #if defined(__linux__) && defined(_GNU_SOURCE)
+            typedef struct mmsghdr SLOG_InternalMsg;
+
+            #define SLOG_INTERNAL_SEND_MSGS(fd, msgs, count) sendmmsg(fd, msgs, count, 0)
+        #else
+            typedef struct SLOG_InternalMsg
+            {
+                struct msghdr msg_hdr;
+                unsigned int msg_len;
+            } SLOG_InternalMsg;
+
+            #if defined(__linux__) && defined(SYS_sendmmsg)
+                #define SLOG_INTERNAL_SEND_MSGS(fd, msgs, count) (int)syscall(SYS_sendmmsg, fd, msgs, count, 0)
+            #else
+                int SLOG_InternalSendMsgs(int fd, SLOG_InternalMsg * msgs, unsigned count)
+                {
+                    unsigned i;
+
+                    for (i = 0; i < count; i++)
+                    {
+                        if (sendmsg(fd, &msgs[i].msg_hdr, 0) < 0)
+                            return i ? (int)i : -1;
+                    }
+
+                    return (int)count;
+                }
+
+                #define SLOG_INTERNAL_SEND_MSGS(fd, msgs, count) SLOG_InternalSendMsgs(fd, msgs, count)
+            #endif
+        #endif
+
+        typedef struct SLOG_InternalSyslogBatch
+        {
+            size_t Size;
+            size_t Count;
+            size_t Ends[SLOG_INTERNAL_SYSLOG_BATCH];
+            char Data[SLOG_INTERNAL_SYSLOG_BUFFER];
+        } SLOG_InternalSyslogBatch;
+
+        struct SLOGSyslogSink
+        {
+            int Fd;
+            int Protocol;
+            int Facility;
+            struct sockaddr_un Address;
+            size_t RetryAt;     /* When to connect again after a failure, in SLOG_InternalNowMs milliseconds. */
+            size_t Dropped;
+            char Header[320];   /* The part of every datagram that doesn't depend on the level. */
+            size_t HeaderSize;
+
+            /*
+             * Writers fill 'Current' while the other batch is sent. A batch
+             * that isn't current and isn't empty is waiting for the sender.
+             */
+            SLOG_InternalSyslogBatch Batches[2];
+            SLOG_InternalSyslogBatch * Current;
+            struct iovec Iov[SLOG_INTERNAL_SYSLOG_BATCH];
+            SLOG_InternalMsg Msgs[SLOG_INTERNAL_SYSLOG_BATCH];
+        #ifndef SLOG_NO_THREADS
+            SLOG_InternalThread Sender;
+            SLOG_InternalMutex Mutex;       /* Guards 'Current', 'Flush' and the counts of the batches. */
+            SLOG_InternalCond Wake;
+            int Flush;                      /* A log of at least SLOGFlushLevel is waiting in 'Current'. */
+            size_t Stop;
+        #endif
+        };
+
+        /*
+         * Syslog severities of the built-in levels.
+         */
+        static const int SLOG_InternalSeverities[] = { 7, 7, 6, 4, 3, 2 };
+
+        /*
+         * Connect the socket of 'sink', unless the last attempt failed less than
+         * SLOG_INTERNAL_SYSLOG_RETRY_MS ago. The socket never blocks.
+         *
+         * Returns whether the sink is connected.
+         */
+        int SLOG_InternalSyslogConnect(SLOGSyslogSink * sink)
+        {
+            size_t now = SLOG_InternalNowMs();
+
+            if (sink->Fd >= 0)
+                return 1;
+
+            if (sink->RetryAt && (ptrdiff_t)(now - sink->RetryAt) < 0)
+                return 0;
+
+            sink->Fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+            if (sink->Fd >= 0)
+            {
+                fcntl(sink->Fd, F_SETFD, FD_CLOEXEC);
+                fcntl(sink->Fd, F_SETFL, fcntl(sink->Fd, F_GETFL) | O_NONBLOCK);
+
+                if (connect(sink->Fd, (const struct sockaddr *)&sink->Address, sizeof(sink->Address)) == 0)
+                {
+                    sink->RetryAt = 0;
+                    return 1;
+                }
+
+                close(sink->Fd);
+                sink->Fd = -1;
+            }
+
+            sink->RetryAt = now + SLOG_INTERNAL_SYSLOG_RETRY_MS;
+
+            return 0;
+        }
+
+        /*
+         * Send the datagrams of 'batch'. Waits up to SLOG_INTERNAL_SYSLOG_WAIT_MS
+         * for the daemon to make room, the datagrams that are left then are
+         * dropped. The caller empties the batch.
+         */
+        void SLOG_InternalSyslogSend(SLOGSyslogSink * sink, SLOG_InternalSyslogBatch * batch)
+        {
+            size_t deadline = SLOG_InternalNowMs() + SLOG_INTERNAL_SYSLOG_WAIT_MS;
+            size_t sent = 0;
+            size_t start = 0;
+            size_t i;
+
+            int reconnected = 0;
+
+            for (i = 0; i < batch->Count; i++)
+            {
+                sink->Iov[i].iov_base = batch->Data + start;
+                sink->Iov[i].iov_len = batch->Ends[i] - start;
+
+                SHRN_MEMSET(&sink->Msgs[i], 0, sizeof(sink->Msgs[i]));
+                sink->Msgs[i].msg_hdr.msg_iov = &sink->Iov[i];
+                sink->Msgs[i].msg_hdr.msg_iovlen = 1;
+
+                start = batch->Ends[i];
+            }
+
+            while (sent < batch->Count && SLOG_InternalSyslogConnect(sink))
+            {
+                int count = SLOG_INTERNAL_SEND_MSGS(sink->Fd, sink->Msgs + sent, (unsigned)(batch->Count - sent));
+
+                if (count > 0)
+                {
+                    sent += (size_t)count;
+                    continue;
+                }
+
+                if (errno == EINTR)
+                    continue;
+
+                /*
+                 * Skip a datagram the daemon refuses.
+                 */
+                if (errno == EMSGSIZE)
+                {
+                    SLOG_INTERNAL_ATOMIC_FETCH_ADD(&sink->Dropped, 1);
+                    sent++;
+                    continue;
+                }
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+                {
+                    struct pollfd writable;
+
+                    ptrdiff_t wait = (ptrdiff_t)(deadline - SLOG_InternalNowMs());
+
+                    writable.fd = sink->Fd;
+                    writable.events = POLLOUT;
+
+                    if (wait > 0 && poll(&writable, 1, (int)wait) >= 0)
+                        continue;
+
+                    break;
+                }
+
+                /*
+                 * The daemon went away, a restarted one listens on a new socket.
+                 */
+                close(sink->Fd);
+                sink->Fd = -1;
+
+                if (reconnected++)
+                    break;
+            }
+
+            SLOG_INTERNAL_ATOMIC_FETCH_ADD(&sink->Dropped, batch->Count - sent);
+        }
+
+        #define SLOG_INTERNAL_SYSLOG_OTHER(sink) (&(sink)->Batches[(sink)->Current == &(sink)->Batches[0]])
+
+        #ifdef SLOG_NO_THREADS
+            /*
+             * Send the datagrams collected so far.
+             */
+            void SLOG_InternalSyslogFlush(SLOGSyslogSink * sink)
+            {
+                SLOG_InternalSyslogBatch * batch = sink->Current;
+
+                if (batch->Count)
+                    SLOG_InternalSyslogSend(sink, batch);
+
+                batch->Count = 0;
+                batch->Size = 0;
+            }
+        #else
+            /*
+             * Send the batch handed over by a writer, or else the current one,
+             * every interval or when woken. Writers continue in the other batch
+             * meanwhile. Sends what is left before it stops.
+             */
+            SLOG_INTERNAL_THREAD_RESULT SLOG_InternalSyslogSenderMain(void * arg)
+            {
+                SLOGSyslogSink * sink = (SLOGSyslogSink *)arg;
+
+                for (;;)
+                {
+                    uint64_t interval = SLOGFlushInterval ? SLOGFlushInterval / 1000000 : 10;
+
+                    SLOG_InternalSyslogBatch * batch;
+
+                    int stop;
+                    int empty;
+
+                    SLOG_InternalMutexLock(&sink->Mutex);
+
+                    if (!SLOG_INTERNAL_SYSLOG_OTHER(sink)->Count && !sink->Flush && !SLOG_INTERNAL_ATOMIC_LOAD(&sink->Stop))
+                        SLOG_InternalCondTimedWait(&sink->Wake, &sink->Mutex, interval < 1 ? 1 : interval < 1000 ? (unsigned)interval : 1000);
+
+                    stop = (int)SLOG_INTERNAL_ATOMIC_LOAD(&sink->Stop);
+                    sink->Flush = 0;
+
+                    batch = SLOG_INTERNAL_SYSLOG_OTHER(sink);
+
+                    if (!batch->Count)
+                    {
+                        batch = sink->Current;
+                        sink->Current = SLOG_INTERNAL_SYSLOG_OTHER(sink);
+                    }
+
+                    SLOG_InternalMutexUnlock(&sink->Mutex);
+
+                    if (batch->Count)
+                        SLOG_InternalSyslogSend(sink, batch);
+
+                    SLOG_InternalMutexLock(&sink->Mutex);
 
-                    SHRN_FREE(copy);
+                    batch->Count = 0;
+                    batch->Size = 0;
+                    empty = !sink->Current->Count;
 
-                    return dst;
+                    SLOG_InternalMutexUnlock(&sink->Mutex);
+
+                    if (stop && empty)
+                        break;
                 }
-            #endif
 
-            #define SHRN_MEMMOVE(dst, src, size) SHRN_InternalMemMove(dst, src, size)
+                return 0;
+            }
         #endif
+    #else
+        struct SLOGSyslogSink
+        {
+            size_t Dropped;
+        };
+    #endif
 
-        #ifndef SHRN_MEMSET
-            void * SHRN_InternalMemset(void * ptr, int val, size_t size);
+    SLOGSyslogSink * SLOGOpenSyslogSink(const char * path, int protocol, const char * ident, int facility)
+    {
+    #ifndef _WIN32
+        SLOGSyslogSink * sink;
 
-            #ifdef SLOG_IMPLEMENTATION
-                void * SHRN_InternalMemset(void * ptr, int val, size_t size)
-                {
-                    while (size--)
-                        ((int8_t *)ptr)[size] = val;
+        SLOG_InternalBuffer header;
 
-                    return ptr;
-                }
-            #endif
+        size_t i;
 
-            #define SHRN_MEMSET(ptr, val, size) SHRN_InternalMemset(ptr, val, size)
-        #endif
+        if (!path)
+            path = protocol == SLOG_SYSLOG_JOURNALD ? "/run/systemd/journal/socket" : "/dev/log";
 
-        #ifndef SHRN_STRLEN
-            size_t SHRN_InternalStrLen(const char * str);
+        if (SHRN_STRLEN(path) >= sizeof(sink->Address.sun_path))
+            return NULL;
 
-            #ifdef SLOG_IMPLEMENTATION
-                size_t SHRN_InternalStrLen(const char * str)
-                {
-                    size_t len = 0;
+        sink = (SLOGSyslogSink *)SHRN_MALLOC(sizeof(SLOGSyslogSink));
 
-                    while (str[len])
-                        len++;
+        if (!sink)
+            return NULL;
 
-                    return len;
-                }
-            #endif
+        SHRN_MEMSET(&sink->Address, 0, sizeof(sink->Address));
+        sink->Address.sun_family = AF_UNIX;
+        SHRN_MEMCPY(sink->Address.sun_path, path, SHRN_STRLEN(path));
 
-            #define SHRN_STRLEN(str) SHRN_InternalStrLen(str)
-        #endif
+        sink->Fd = -1;
+        sink->Protocol = protocol;
+        sink->RetryAt = 0;
+        sink->Dropped = 0;
+        sink->Facility = facility < 0 ? 0 : facility > 23 ? 23 : facility;
+        sink->Batches[0].Size = 0;
+        sink->Batches[0].Count = 0;
+        sink->Batches[1].Size = 0;
+        sink->Batches[1].Count = 0;
+        sink->Current = &sink->Batches[0];
 
-        #ifndef SHRN_STRNCMP
-            int SHRN_InternalStrNCmp(const char * str0, const char * str1, size_t n);
+        header.Data = sink->Header;
+        header.Size = 0;
+        header.Capacity = sizeof(sink->Header);
+        header.Growable = 0;
+        header.Color = 0;
 
-            #ifdef SLOG_IMPLEMENTATION
-                int SHRN_InternalStrNCmp(const char * str0, const char * str1, size_t n)
-                {
-                    size_t i = 0;
+        if (protocol == SLOG_SYSLOG_JOURNALD)
+        {
+            SLOG_InternalBufferAppendP(&header, "SYSLOG_FACILITY=");
+            SLOG_InternalBufferAppendInt(&header, (uint64_t)sink->Facility, 0, 10, -1, 0);
 
-                    size_t len = SHRN_STRLEN(str0);
+            if (ident)
+            {
+                SLOG_InternalBufferAppendP(&header, "\nSYSLOG_IDENTIFIER=");
+                SLOG_InternalBufferAppend(&header, ident, SHRN_STRLEN(ident) < 255 ? SHRN_STRLEN(ident) : 255);
+            }
 
-                    if (SHRN_STRLEN(str1) < len)
-                        len = SHRN_STRLEN(str1);
+            SLOG_InternalBufferAppendP(&header, "\nSYSLOG_PID=");
+            SLOG_InternalBufferAppendInt(&header, (uint64_t)getpid(), 0, 10, -1, 0);
+            SLOG_InternalBufferAppendC(&header, '\n');
+        }
+        else
+        {
+            char host[256];
 
-                    if (n < len)
-                        len = n;
+            /*
+             * '1 - <host> <ident> <pid> - - ', the version, no timestamp, no message id and no structured data.
+             */
+            SLOG_InternalBufferAppend(&header, "1 - ", 4);
 
-                    for (i = 0; i < len; i++)
-                        if (str0[i] != str1[i])
-                            return str0[i] - str1[i];
+            if (gethostname(host, sizeof(host)) == 0)
+            {
+                host[sizeof(host) - 1] = 0;
+                SLOG_InternalBufferAppendP(&header, host[0] ? host : "-");
+            }
+            else
+            {
+                SLOG_InternalBufferAppendC(&header, '-');
+            }
 
-                    return 0;
-                }
-            #endif
+            SLOG_InternalBufferAppendC(&header, ' ');
 
-            #define SHRN_STRNCMP(str0, str1, n) SHRN_InternalStrNCmp(str0, str1, n)
-        #endif
-    #else
-        #include <string.h>
+            if (ident && ident[0])
+            {
+                /*
+                 * The app name is up to 48 printable characters.
+                 */
+                for (i = 0; ident[i] && i < 48; i++)
+                    SLOG_InternalBufferAppendC(&header, ident[i] > ' ' && ident[i] < 127 ? ident[i] : '_');
+            }
+            else
+            {
+                SLOG_InternalBufferAppendC(&header, '-');
+            }
 
-        #define SHRN_MEMCPY(dst, src, size)   memcpy(dst, src, size)
-        #define SHRN_MEMMOVE(dst, src, size)  memmove(dst, src, size)
-        #define SHRN_MEMSET(ptr, val, size)   memset(ptr, val, size)
-        #define SHRN_STRLEN(str)              strlen(str)
-        #define SHRN_STRNCMP(str0, str1, n)   strncmp(str0, str1, n)
-    #endif
+            SLOG_InternalBufferAppendC(&header, ' ');
+            SLOG_InternalBufferAppendInt(&header, (uint64_t)getpid(), 0, 10, -1, 0);
+            SLOG_InternalBufferAppend(&header, " - - ", 5);
+        }
 
-    char * SLOG_InternalToStringI(int val, int base, int width)
-    {
-        int i = 0;
+        sink->HeaderSize = header.Size;
 
         /*
-         * Maximum number of digits an int can store in a 'base' number system.
+         * A daemon that isn't there yet is retried by the first send.
          */
-        int digitCount;
+        SLOG_InternalSyslogConnect(sink);
+
+    #ifndef SLOG_NO_THREADS
+        sink->Stop = 0;
+
+        sink->Flush = 0;
 
-        switch(base)
+        SLOG_InternalMutexInit(&sink->Mutex);
+        SLOG_InternalCondInit(&sink->Wake);
+
+        if (!SLOG_InternalThreadStart(&sink->Sender, SLOG_InternalSyslogSenderMain, sink))
         {
-            case 8: digitCount = SHRN_CEIL((sizeof(int) * 8) / 3.0); break;
-            case 16: digitCount = SHRN_CEIL((sizeof(int) * 8) / 4.0); break;
+            SLOG_InternalCondDestroy(&sink->Wake);
+            SLOG_InternalMutexDestroy(&sink->Mutex);
 
-            case 10:
-            default:
-                     digitCount = SHRN_CEIL((sizeof(int) * 8) / 3.32); break;
+            if (sink->Fd >= 0)
+                close(sink->Fd);
+
+            SHRN_FREE(sink);
+
+            return NULL;
         }
+    #endif
+
+        return sink;
+    #else
+        (void)path;
+        (void)protocol;
+        (void)ident;
+        (void)facility;
+
+        return NULL;
+    #endif
+    }
+
+    void SLOGCloseSyslogSink(SLOGSyslogSink * sink)
+    {
+    #ifndef _WIN32
+    #ifndef SLOG_NO_THREADS
+        SLOG_INTERNAL_ATOMIC_STORE(&sink->Stop, 1);
 
-        int negative = val < 0;
+        SLOG_InternalMutexLock(&sink->Mutex);
+        SLOG_InternalCondSignal(&sink->Wake);
+        SLOG_InternalMutexUnlock(&sink->Mutex);
 
         /*
-         * When 'val' is positive, negative is 0, so the sign gets allocated
-         * seperately only if the 'val' is negative.
+         * The sender sends what is left before it stops.
          */
-        int strSize = digitCount + negative;
+        SLOG_InternalThreadJoin(sink->Sender);
 
-        char * str = SUTLStringNew();
-        SUTLStringResize(str, strSize);
-
-        int digitStart = 0;
+        SLOG_InternalCondDestroy(&sink->Wake);
+        SLOG_InternalMutexDestroy(&sink->Mutex);
+    #else
+        SLOG_InternalSyslogFlush(sink);
+    #endif
 
-        if (negative)
-        {
-            str[0] = '-';
-            digitStart = 1;
+        if (sink->Fd >= 0)
+            close(sink->Fd);
+    #endif
 
-            /* 'val' must be positive after this block. */
-            val = -val;
-        }
+        SHRN_FREE(sink);
+    }
 
-        unsigned long digitSignificance = SHRN_POW(base, digitCount - 1);
+    size_t SLOGGetSyslogSinkDropped(const SLOGSyslogSink * sink)
+    {
+    #ifndef _WIN32
+        return SLOG_INTERNAL_ATOMIC_LOAD(&((SLOGSyslogSink *)sink)->Dropped);
+    #else
+        return sink->Dropped;
+    #endif
+    }
 
-        for (i = digitStart; i < digitCount; i++)
-        {
-            str[i] = '0' + val / digitSignificance;
+    void SLOGSyslogSinkWrite(void * user, int level, const char * data, size_t size)
+    {
+    #ifndef _WIN32
+        SLOGSyslogSink * sink = (SLOGSyslogSink *)user;
+        SLOG_InternalSyslogBatch * batch;
 
-            val %= digitSignificance;
-            digitSignificance /= base;
+        SLOG_InternalBuffer out;
 
-            /*
-             * Use characters A-Z for values greater than 9.
-             */
-            if (str[i] > '9')
-                str[i] = 'A' + (str[i] - '9' - 1);
-        }
+        int severity = SLOG_InternalSeverities[level < SLOG_LEVEL_TRACE ? SLOG_LEVEL_TRACE : level > SLOG_LEVEL_FATAL ? SLOG_LEVEL_FATAL : level];
 
-        int numLeadingZeros = 0;
+        size_t room;
+        size_t i;
 
-        for (i = digitStart; i < digitCount && str[i] == '0'; i++)
-            numLeadingZeros++;
+        if (size && data[size - 1] == '\n')
+            size--;
 
         /*
-         * If all digits are zero than there should be one zero left.
+         * Room for the header, the priority and the framing of the message.
          */
-        if (digitCount == numLeadingZeros)
-            numLeadingZeros--;
+        room = sink->HeaderSize + 48;
+
+        if (size > SLOG_INTERNAL_SYSLOG_MAX - room)
+            size = SLOG_INTERNAL_SYSLOG_MAX - room;
+
+    #ifndef SLOG_NO_THREADS
+        SLOG_InternalMutexLock(&sink->Mutex);
+    #endif
 
-        if (width != -1)
+        batch = sink->Current;
+
+        /*
+         * Without threads every log is sent right away, so there is always
+         * room. Otherwise a full batch is handed over to the sender, and
+         * while it is still sending the other one the log is dropped.
+         */
+        if (batch->Count == SLOG_INTERNAL_SYSLOG_BATCH || batch->Size + room + size > SLOG_INTERNAL_SYSLOG_BUFFER)
         {
-            if (strSize > width)
+        #ifndef SLOG_NO_THREADS
+            SLOG_InternalCondSignal(&sink->Wake);
+
+            if (SLOG_INTERNAL_SYSLOG_OTHER(sink)->Count)
             {
-                int count = strSize - width;
+                SLOG_INTERNAL_ATOMIC_FETCH_ADD(&sink->Dropped, 1);
+                SLOG_InternalMutexUnlock(&sink->Mutex);
+
+                return;
+            }
+
+            batch = SLOG_INTERNAL_SYSLOG_OTHER(sink);
+            sink->Current = batch;
+        #endif
+        }
+
+        out.Data = batch->Data + batch->Size;
+        out.Size = 0;
+        out.Capacity = SLOG_INTERNAL_SYSLOG_BUFFER - batch->Size;
+        out.Growable = 0;
+        out.Color = 0;
+
+        if (sink->Protocol == SLOG_SYSLOG_JOURNALD)
+        {
+            SLOG_InternalBufferAppend(&out, "PRIORITY=", 9);
+            SLOG_InternalBufferAppendC(&out, (char)('0' + severity));
+            SLOG_InternalBufferAppendC(&out, '\n');
+            SLOG_InternalBufferAppend(&out, sink->Header, sink->HeaderSize);
 
-                if (count <= numLeadingZeros)
-                    SUTLStringEraseN(str, 0, count);
+            /*
+             * Values with newlines are sent as the key, a newline and the 64-bit little endian size.
+             */
+            for (i = 0; i < size && data[i] != '\n'; i++)
+            {
             }
-            else if (strSize < width)
+
+            if (i < size)
             {
-                const char zero = '0';
+                char length[8];
 
-                int count = width - strSize;
+                for (i = 0; i < 8; i++)
+                    length[i] = (char)((uint64_t)size >> (i * 8));
 
-                for (; count != 0; count--)
-                    SUTLStringInsertC(str, 0, zero);
+                SLOG_InternalBufferAppend(&out, "MESSAGE\n", 8);
+                SLOG_InternalBufferAppend(&out, length, 8);
             }
+            else
+            {
+                SLOG_InternalBufferAppend(&out, "MESSAGE=", 8);
+            }
+
+            SLOG_InternalBufferAppend(&out, data, size);
+            SLOG_InternalBufferAppendC(&out, '\n');
         }
         else
         {
-            SUTLStringEraseN(str, 0, numLeadingZeros);
+            SLOG_InternalBufferAppendC(&out, '<');
+            SLOG_InternalBufferAppendInt(&out, (uint64_t)(sink->Facility * 8 + severity), 0, 10, -1, 0);
+            SLOG_InternalBufferAppendC(&out, '>');
+            SLOG_InternalBufferAppend(&out, sink->Header, sink->HeaderSize);
+            SLOG_InternalBufferAppend(&out, data, size);
+        }
+
+        batch->Size += out.Size;
+        batch->Ends[batch->Count++] = batch->Size;
+
+    #ifdef SLOG_NO_THREADS
+        SLOG_InternalSyslogFlush(sink);
+    #else
+        if (level >= SLOGFlushLevel)
+        {
+            sink->Flush = 1;
+            SLOG_InternalCondSignal(&sink->Wake);
         }
 
-        return str;
+        SLOG_InternalMutexUnlock(&sink->Mutex);
+    #endif
+    #else
+        (void)user;
+        (void)level;
+        (void)data;
+        (void)size;
+    #endif
     }
 
-    char * SLOG_InternalToStringUI(unsigned int val, int base, int width)
+    /*
+     * Render 'log' for the output file into 'out', as a TEXT entry in binary files.
+     */
+    void SLOG_InternalRenderFileLog(SLOG_InternalBuffer * out, const SLOG_InternalLog * log)
     {
-        int i = 0;
+        SLOG_InternalLog text;
+
+        size_t start = out->Size;
+
+        uint32_t size;
+
+        if (!SLOGBinary)
+        {
+            SLOG_InternalRenderLog(out, SLOGFileEncoding, log);
+            return;
+        }
 
         /*
-         * Maximum number of digits an int can store in a 'base' number system.
+         * The time is in the header, whose size is filled in once the text is rendered.
          */
-        int digitCount;
+        text = *log;
+        text.Time = 0;
 
-        switch(base)
-        {
-            case 8: digitCount = SHRN_CEIL((sizeof(int) * 8) / 3.0); break;
-            case 16: digitCount = SHRN_CEIL((sizeof(int) * 8) / 4.0); break;
+        SLOG_InternalBinaryAppendEntry(out, SLOG_INTERNAL_ENTRY_TEXT, log->Level, log->Time, 0);
+        SLOG_InternalRenderLog(out, SLOG_ENCODING_TEXT, &text);
 
-            case 10:
-            default:
-                     digitCount = SHRN_CEIL((sizeof(int) * 8) / 3.32); break;
+        if (out->Size <= out->Capacity)
+        {
+            size = (uint32_t)(out->Size - start - 4);
+            SHRN_MEMCPY(out->Data + start, &size, sizeof(size));
         }
+    }
 
-        int strSize = digitCount;
+    /*
+     * Write 'log', which has no program, to the output file and sinks.
+     */
+    void SLOG_InternalLogMessage(const SLOG_InternalLog * log)
+    {
+        char line[512];
 
-        char * str = (char *)SHRN_MALLOC(strSize + 1);
-        SHRN_MEMSET(str, 0, strSize + 1);
+        SLOG_InternalThreadState * state = SLOG_InternalArenaEnter();
 
-        unsigned long digitSignificance = SHRN_POW(base, digitCount - 1);
+        SLOG_InternalBuffer out;
+        SLOG_InternalBuffer * buf = NULL;
 
-        for (i = 0; i < digitCount; i++)
+        if (log->Level >= SLOG_INTERNAL_FILTER_LEVEL())
         {
-            str[i] = '0' + val / digitSignificance;
+            out.Data = line;
+            out.Size = 0;
+            out.Capacity = sizeof(line);
+            out.Growable = 0;
+            out.Color = SLOGBinary ? 0 : SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
+
+            buf = &out;
+            SLOG_InternalRenderFileLog(buf, log);
+
+            /*
+             * The log has to be written at once, use the arena when it doesn't fit on the stack.
+             */
+            if (out.Size > out.Capacity)
+            {
+                SLOG_InternalArenaBuffer(state, buf, out.Color, out.Size);
+                SLOG_InternalRenderFileLog(buf, log);
+            }
 
-            val %= digitSignificance;
-            digitSignificance /= base;
+            SLOG_InternalWrite(log->Level, buf->Data, buf->Size);
 
             /*
-             * Use characters A-Z for values greater than 9.
+             * Binary entries can't be handed to sinks.
              */
-            if (str[i] > '9')
-                str[i] = 'A' + (str[i] - '9' - 1);
+            if (SLOGBinary)
+                buf = NULL;
         }
 
-        int numLeadingZeros = 0;
+        if (SLOG_INTERNAL_SINK_LEVELS() & SLOG_INTERNAL_LEVEL_BIT(log->Level))
+            SLOG_InternalWriteSinks(state, log, buf);
 
-        for (i = 0; i < digitCount && str[i] == '0'; i++)
-            numLeadingZeros++;
+        SLOG_InternalArenaLeave(state);
+    }
 
-        /*
-         * If all digits are zero than there should be one zero left.
-         */
-        if (digitCount == numLeadingZeros)
-            numLeadingZeros--;
+    void SLOGLog(int level, const char * prefix, const char * msg)
+    {
+        SLOG_InternalLog log;
 
-        if (width != -1)
-        {
-            if (strSize > width)
-            {
-                int count = strSize - width;
+        if (!SLOG_INTERNAL_TAKEN(level))
+            return;
 
-                if (count <= numLeadingZeros)
-                    SUTLStringEraseN(str, 0, count);
-            }
-            else if (strSize < width)
-            {
-                const char zero = '0';
+        SHRN_MEMSET(&log, 0, sizeof(log));
 
-                int count = width - strSize;
+        log.Level = level;
+        log.Time = SLOG_INTERNAL_LOG_TIME();
+        log.Prefix = prefix;
+        log.Message = msg;
 
-                for (; count != 0; count--)
-                    SUTLStringInsertC(str, 0, zero);
-            }
-        }
-        else
-        {
-            SUTLStringEraseN(str, 0, numLeadingZeros);
-        }
+        SLOG_InternalLogMessage(&log);
+    }
+
+    /*
+     * Write a log with fields, of 'site' if not NULL.
+     */
+    void SLOG_InternalLogFields(int level, const SLOGSite * site, const char * msg, const SLOGField * fields, size_t count)
+    {
+        static const SLOGField none[1] = { { "", SLOG_FIELD_BOOL, { 0 } } };
+
+        SLOG_InternalLog log;
 
-        return str;
+        SHRN_MEMSET(&log, 0, sizeof(log));
+
+        log.Level = level;
+        log.Time = SLOG_INTERNAL_LOG_TIME();
+        log.Site = site;
+        log.Message = msg;
+        log.Fields = fields && count ? fields : none;
+        log.FieldCount = fields ? count : 0;
+
+        SLOG_InternalLogMessage(&log);
     }
 
-    char * SLOG_InternalToStringL(long val, int base, int width)
+    void SLOGLogFields(int level, const char * msg, const SLOGField * fields, size_t count)
     {
-        int i = 0;
+        if (SLOG_INTERNAL_TAKEN(level))
+            SLOG_InternalLogFields(level, NULL, msg, fields, count);
+    }
+
+    const SLOGField SLOGFieldEnd = { NULL, SLOG_FIELD_BOOL, { 0 } };
+
+    SLOGField SLOGFieldInt(const char * key, int64_t value)
+    {
+        SLOGField field;
+
+        field.Key = key;
+        field.Type = SLOG_FIELD_INT;
+        field.Value.Int = value;
+
+        return field;
+    }
+
+    SLOGField SLOGFieldUint(const char * key, uint64_t value)
+    {
+        SLOGField field;
+
+        field.Key = key;
+        field.Type = SLOG_FIELD_UINT;
+        field.Value.Uint = value;
+
+        return field;
+    }
+
+    SLOGField SLOGFieldFloat(const char * key, double value)
+    {
+        SLOGField field;
+
+        field.Key = key;
+        field.Type = SLOG_FIELD_FLOAT;
+        field.Value.Float = value;
+
+        return field;
+    }
+
+    SLOGField SLOGFieldBool(const char * key, int value)
+    {
+        SLOGField field;
+
+        field.Key = key;
+        field.Type = SLOG_FIELD_BOOL;
+        field.Value.Bool = value != 0;
+
+        return field;
+    }
+
+    SLOGField SLOGFieldString(const char * key, const char * value)
+    {
+        SLOGField field;
+
+        field.Key = key;
+        field.Type = SLOG_FIELD_STRING;
+        field.Value.String = value;
+
+        return field;
+    }
+
+    /*
+     * Write a LOG entry for 'program' with the arguments in 'ap' from the logging thread.
+     */
+    void SLOG_InternalLogBinary(SLOG_InternalThreadState * state, int level, uint64_t time, const SLOGFormatProgram * program, va_list * ap)
+    {
+        char line[512];
+        char args[256];
+
+        char * captured = args;
+
+        SLOG_InternalBuffer out;
+        SLOG_InternalBuffer * buf = &out;
+
+        size_t size;
+        size_t binaryFile = 0;
+
+        va_list copy;
+
+        int async = 0;
+        int define;
+
+        FILE * file;
+
+    #ifndef SLOG_NO_THREADS
+        async = (int)SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Running);
+    #endif
+
+        va_copy(copy, *ap);
+
+        size = SLOG_InternalCaptureV(args, sizeof(args), program, ap);
 
         /*
-         * Maximum number of digits an int can store in a 'base' number system.
+         * Only use the arena when the arguments don't fit on the stack.
          */
-        int digitCount;
-
-        switch(base)
+        if (size > sizeof(args))
         {
-            case 8: digitCount = SHRN_CEIL((sizeof(int) * 8) / 3.0); break;
-            case 16: digitCount = SHRN_CEIL((sizeof(int) * 8) / 4.0); break;
+            captured = (char *)SLOG_InternalArenaAlloc(state, size);
 
-            case 10:
-            default:
-                     digitCount = SHRN_CEIL((sizeof(int) * 8) / 3.32); break;
+            SLOG_InternalCaptureV(captured, size, program, &copy);
         }
 
-        int negative = val < 0;
+        va_end(copy);
 
         /*
-         * When 'val' is positive, negative is 0, so the sign gets allocated
-         * seperately only if the 'val' is negative.
+         * Only the writer thread tracks written formats while it runs, logs
+         * written beside it always carry their FORMAT entry.
          */
-        int strSize = digitCount + negative;
+        file = SLOG_InternalEnterOutput();
+
+        if (!async)
+            binaryFile = SLOG_INTERNAL_ATOMIC_LOAD(&SLOGBinaryFile);
+
+        out.Data = line;
+        out.Size = 0;
+        out.Capacity = sizeof(line);
+        out.Growable = 0;
+        out.Color = 0;
+
+        define = SLOG_InternalBinaryAppendLog(buf, level, time, program, captured, size, binaryFile);
+
+        if (out.Size > sizeof(line))
+        {
+            SLOG_InternalArenaBuffer(state, buf, 0, out.Size);
+
+            SLOG_InternalBinaryAppendLog(buf, level, time, program, captured, size, binaryFile);
+        }
+
+        if (async)
+        {
+            SLOG_InternalLeaveOutput();
+            SLOG_InternalWrite(level, buf->Data, buf->Size);
+        }
+        else
+        {
+            SLOG_InternalOutputLog(file, buf->Data, buf->Size, level >= SLOGFlushLevel);
+
+            if (define)
+                SLOG_InternalBinaryMarkFormat(program, binaryFile);
+
+            SLOG_InternalLeaveOutput();
+        }
+    }
+
+    /*
+     * Write 'log', which has a program, to the output file. 'out' is an empty
+     * stack buffer, larger logs are rendered in the arena of 'state'.
+     *
+     * Returns the rendering of the log in SLOGFileEncoding, or NULL if it wasn't rendered.
+     */
+    SLOG_InternalBuffer * SLOG_InternalLogFile(SLOG_InternalThreadState * state, const SLOG_InternalLog * log, SLOG_InternalBuffer * out)
+    {
+        va_list copy;
 
-        char * str = (char *)SHRN_MALLOC(strSize + 1);
-        SHRN_MEMSET(str, 0, strSize + 1);
+    #ifndef SLOG_NO_THREADS
+        if (SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Running) && SLOGAsync.Deferred)
+        {
+            int queued;
 
-        int digitStart = 0;
+            va_copy(copy, *log->Args);
+            queued = SLOG_InternalQueueDeferred(&SLOGAsync.Queue, log->Level, log->Time, log->Site, log->Program, &copy);
+            va_end(copy);
 
-        if (negative)
-        {
-            str[0] = '-';
-            digitStart = 1;
+            if (queued)
+            {
+                if (log->Level >= SLOGFlushLevel)
+                    SLOGFlush();
 
-            /* 'val' must be positive after this block. */
-            val = -val;
+                return NULL;
+            }
         }
+    #endif
 
-        unsigned long long digitSignificance = SHRN_POW(base, digitCount - 1);
-
-        for (i = digitStart; i < digitCount; i++)
+        if (SLOGBinary)
         {
-            str[i] = '0' + val / digitSignificance;
+            va_copy(copy, *log->Args);
+            SLOG_InternalLogBinary(state, log->Level, log->Time, log->Program, &copy);
+            va_end(copy);
 
-            val %= digitSignificance;
-            digitSignificance /= base;
-
-            /*
-             * Use characters A-Z for values greater than 9.
-             */
-            if (str[i] > '9')
-                str[i] = 'A' + (str[i] - '9' - 1);
+            return NULL;
         }
 
-        int numLeadingZeros = 0;
+        out->Color = SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
 
-        for (i = digitStart; i < digitCount && str[i] == '0'; i++)
-            numLeadingZeros++;
+        SLOG_InternalRenderLog(out, SLOGFileEncoding, log);
 
         /*
-         * If all digits are zero than there should be one zero left.
+         * Use the arena when the line doesn't fit on the stack.
          */
-        if (digitCount == numLeadingZeros)
-            numLeadingZeros--;
-
-        if (width != -1)
+        if (out->Size > out->Capacity)
         {
-            if (strSize > width)
-            {
-                int count = strSize - width;
-
-                if (count <= numLeadingZeros)
-                    SUTLStringEraseN(str, 0, count);
-            }
-            else if (strSize < width)
-            {
-                const char zero = '0';
+            SLOG_InternalArenaBuffer(state, out, out->Color, out->Size);
 
-                int count = width - strSize;
-
-                for (; count != 0; count--)
-                    SUTLStringInsertC(str, 0, zero);
-            }
-        }
-        else
-        {
-            SUTLStringEraseN(str, 0, numLeadingZeros);
+            SLOG_InternalRenderLog(out, SLOGFileEncoding, log);
         }
 
-        return str;
+        SLOG_InternalWrite(log->Level, out->Data, out->Size);
+
+        return out;
     }
 
-    char * SLOG_InternalToStringUL(unsigned long val, int base, int width)
+    /*
+     * Write a log of 'program' with the built-in prefix of 'level' to the
+     * output file and sinks. 'site' is the call site of the log, or NULL.
+     */
+    void SLOG_InternalLogProgram(int level, const SLOGSite * site, const SLOGFormatProgram * program, va_list * ap)
     {
-        int i = 0;
+        char line[512];
 
-        /*
-         * Maximum number of digits an int can store in a 'base' number system.
-         */
-        int digitCount;
+        SLOG_InternalThreadState * state = SLOG_InternalArenaEnter();
 
-        switch(base)
-        {
-            case 8: digitCount = SHRN_CEIL((sizeof(int) * 8) / 3.0); break;
-            case 16: digitCount = SHRN_CEIL((sizeof(int) * 8) / 4.0); break;
+        SLOG_InternalBuffer out;
+        SLOG_InternalBuffer * rendered = NULL;
 
-            case 10:
-            default:
-                     digitCount = SHRN_CEIL((sizeof(int) * 8) / 3.32); break;
-        }
+        SLOG_InternalLog log;
 
-        int strSize = digitCount;
+        SHRN_MEMSET(&log, 0, sizeof(log));
 
-        char * str = (char *)SHRN_MALLOC(strSize + 1);
-        SHRN_MEMSET(str, 0, strSize + 1);
+        log.Level = level;
+        log.Time = SLOG_INTERNAL_LOG_TIME();
+        log.Site = site;
+        log.Program = program;
+        log.Args = ap;
 
-        unsigned long long digitSignificance = SHRN_POW(base, digitCount - 1);
+        out.Data = line;
+        out.Size = 0;
+        out.Capacity = sizeof(line);
+        out.Growable = 0;
+        out.Color = 0;
 
-        for (i = 0; i < digitCount; i++)
-        {
-            str[i] = '0' + val / digitSignificance;
+        if (level >= SLOG_INTERNAL_FILTER_LEVEL())
+            rendered = SLOG_InternalLogFile(state, &log, &out);
 
-            val %= digitSignificance;
-            digitSignificance /= base;
+        if (SLOG_INTERNAL_SINK_LEVELS() & SLOG_INTERNAL_LEVEL_BIT(level))
+            SLOG_InternalWriteSinks(state, &log, rendered);
 
-            /*
-             * Use characters A-Z for values greater than 9.
-             */
-            if (str[i] > '9')
-                str[i] = 'A' + (str[i] - '9' - 1);
-        }
+        SLOG_InternalArenaLeave(state);
+    }
 
-        int numLeadingZeros = 0;
+    void SLOGLogCached(int level, SLOGFormatProgram ** cache, const char * fmt, ...)
+    {
+        const SLOGFormatProgram * program;
 
-        for (i = 0; i < digitCount && str[i] == '0'; i++)
-            numLeadingZeros++;
+        va_list ap;
 
-        /*
-         * If all digits are zero than there should be one zero left.
-         */
-        if (digitCount == numLeadingZeros)
-            numLeadingZeros--;
+        if (!SLOG_INTERNAL_TAKEN(level))
+            return;
 
-        if (width != -1)
-        {
-            if (strSize > width)
-            {
-                int count = strSize - width;
+        program = SLOGCompileFormatOnce(cache, fmt);
 
-                if (count <= numLeadingZeros)
-                    SUTLStringEraseN(str, 0, count);
-            }
-            else if (strSize < width)
-            {
-                const char zero = '0';
+        if (!program)
+            return;
 
-                int count = width - strSize;
+        va_start(ap, fmt);
+        SLOG_InternalLogProgram(level, NULL, program, &ap);
+        va_end(ap);
+    }
 
-                for (; count != 0; count--)
-                    SUTLStringInsertC(str, 0, zero);
-            }
-        }
-        else
-        {
-            SUTLStringEraseN(str, 0, numLeadingZeros);
-        }
+    /*
+     * The registry of call sites, a table of chunks that are allocated as
+     * needed and never move, so sites can be looked up without a lock.
+     */
+    #define SLOG_INTERNAL_SITE_CHUNK  256
+    #define SLOG_INTERNAL_SITE_CHUNKS 1024
 
-        return str;
-    }
+    static SLOGSite ** SLOGSiteChunks[SLOG_INTERNAL_SITE_CHUNKS];
+    static size_t SLOGSiteCount = 0;
 
-    char * SLOG_InternalToStringD(double d, int precision)
+    /*
+     * Give 'site' the next id and publish it in the registry, unless another
+     * thread does so already. Sites past the capacity of the registry keep
+     * logging without an id.
+     */
+    void SLOG_InternalRegisterSite(SLOGSite * site, const char * fmt)
     {
-        int i = 0;
+        SLOGSite ** chunk;
+
+        size_t claim = 0;
+        size_t id;
+
+        SLOG_InternalBuffer rendered;
+
+        if (!SLOG_INTERNAL_ATOMIC_CAS(&site->Id, &claim, (size_t)-1))
+            return;
+
+        site->Format = fmt;
 
         /*
-         * Convert the integer part of 'd'.
+         * Measure the logfmt key of the site, then render it for good.
          */
-        char * str = SLOG_InternalToStringL((long)d, 10, -1);
+        rendered.Data = NULL;
+        rendered.Size = 0;
+        rendered.Capacity = 0;
+        rendered.Growable = 0;
+        rendered.Color = 0;
 
-        int zeroPrecision = precision == 0;
+        SLOG_InternalRenderSite(&rendered, site);
 
-        str = (char *)SHRN_REALLOC(str, SHRN_STRLEN(str) + precision + zeroPrecision + 1);
-        SHRN_MEMSET(str + SHRN_STRLEN(str), 0, precision + zeroPrecision + 1);
+        rendered.Data = (char *)SLOG_InternalSiteAlloc(rendered.Size);
+
+        if (rendered.Data)
+        {
+            rendered.Capacity = rendered.Size;
+            rendered.Size = 0;
 
-        if (precision != 0)
-            str[SHRN_STRLEN(str)] = '.';
+            SLOG_InternalRenderSite(&rendered, site);
 
-        char * fracStr = str + SHRN_STRLEN(str);
+            site->LogfmtSize = rendered.Size;
+            SLOG_INTERNAL_ATOMIC_STORE_PTR(&site->Logfmt, (const char *)rendered.Data);
+        }
 
-        float frac = d - (uint32_t)d;
+        id = SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGSiteCount, 1);
 
-        for (i = 0; i < (precision == -1 ? 6 : precision); i++)
+        if (id >= SLOG_INTERNAL_SITE_CHUNK * SLOG_INTERNAL_SITE_CHUNKS)
         {
-            fracStr[i] = '0' + (uint32_t)(frac * 10);
-            frac *= 10;
-            frac -= (uint32_t)frac;
+            SLOG_INTERNAL_ATOMIC_FETCH_ADD(&SLOGSiteCount, (size_t)-1);
+            return;
         }
 
-        if (precision == -1)
+        chunk = (SLOGSite **)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGSiteChunks[id / SLOG_INTERNAL_SITE_CHUNK]);
+
+        if (!chunk)
         {
-            /*
-             * Remove trailing zeroes.
-             */
-            for (i = precision - 1; i >= 0 && fracStr[i] == '0'; i--)
-                fracStr[i] = 0;
+            SLOGSite ** fresh = (SLOGSite **)SLOG_InternalSiteAlloc(SLOG_INTERNAL_SITE_CHUNK * sizeof(SLOGSite *));
 
-            /*
-             * Make sure 'str' doesn't end with a '.'.
-             */
-            if (str[SHRN_STRLEN(str) - 1] == '.')
-                str[SHRN_STRLEN(str) - 1] = 0;
+            if (!fresh)
+                return;
 
-            str = (char *)SHRN_REALLOC(str, SHRN_STRLEN(str) + 1);
+            SHRN_MEMSET(fresh, 0, SLOG_INTERNAL_SITE_CHUNK * sizeof(SLOGSite *));
+
+            if (SLOG_INTERNAL_ATOMIC_CAS_PTR(&SLOGSiteChunks[id / SLOG_INTERNAL_SITE_CHUNK], &chunk, fresh))
+                chunk = fresh;
+            else
+                SLOG_InternalSiteFree(fresh);
         }
 
-        return str;
+        SLOG_INTERNAL_ATOMIC_STORE(&site->Id, id + 1);
+        SLOG_INTERNAL_ATOMIC_STORE_PTR(&chunk[id % SLOG_INTERNAL_SITE_CHUNK], site);
     }
 
-    char * SLOGFormat(const char * fmt, ...)
+    void SLOGLogSite(SLOGSite * site, const char * fmt, ...)
     {
-        size_t i = 0;
+        const SLOGFormatProgram * program;
 
-        typedef struct ArgValue
-        {
-            size_t Location;
-            size_t Size;
-            SUTLString Value;
-        } ArgValue;
+        va_list ap;
 
-        ArgValue * values = SUTLVectorNew(ArgValue);
+        if (!SLOG_INTERNAL_TAKEN(site->Level))
+            return;
 
-        va_list ap;
-        va_start(ap, fmt);
+        program = SLOGCompileFormatOnce(&site->Program, fmt);
 
-        for (i = 0; i < SHRN_STRLEN(fmt); i++)
-        {
-            int width = -1;
-            int precision = -1;
+        /*
+         * Skip the log if its format couldn't be compiled.
+         */
+        if (!program)
+            return;
 
-            SUTLString widthStr = SUTLStringNew();
-            SUTLString precisionStr = SUTLStringNew();
+        if (!SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&site->Id))
+            SLOG_InternalRegisterSite(site, fmt);
 
-            int o = 0; /* Octal output flag. */
-            int x = 0; /* Hexadecimal output flag. */
+        va_start(ap, fmt);
+        SLOG_InternalLogProgram(site->Level, site, program, &ap);
+        va_end(ap);
+    }
 
-            int l = 0; /* 'long' length modifier flag. */
-            int z = 0; /* 'size' length modifier flag.*/
+    void SLOGLogFieldList(SLOGSite * site, const char * msg, ...)
+    {
+        SLOG_InternalThreadState * state;
 
-            /*
-             * Parse a '%' sequence
-             */
-            if (fmt[i] == '%')
-            {
-                SUTLVectorResize(values, SUTLVectorSize(values) + 1);
+        SLOGField * fields;
 
-                ArgValue * value = &values[SUTLVectorSize(values) - 1];
+        size_t count = 0;
+        size_t i;
 
-                value->Location = i++;
+        va_list ap;
 
-                if (fmt[i] == '=')
-                {
-                    i++;
+        if (!SLOG_INTERNAL_TAKEN(site->Level))
+            return;
 
-                    const char * color = &fmt[i];
+        if (!SLOG_INTERNAL_ATOMIC_LOAD_RELAXED(&site->Id))
+            SLOG_InternalRegisterSite(site, msg);
 
-                    i += 3;
+        va_start(ap, msg);
 
-                    const char * style = &fmt[i];
+        while (va_arg(ap, SLOGField).Key)
+            count++;
 
-                    i += 2;
+        va_end(ap);
 
-                    char * val = SUTLStringNew();
+        state = SLOG_InternalArenaEnter();
 
-                    uint8_t index = 0;
+        fields = count ? (SLOGField *)SLOG_InternalArenaAlloc(state, count * sizeof(SLOGField)) : NULL;
 
-                    SUTLStringAppendP(val, "\033[0;");
+        if (fields || !count)
+        {
+            va_start(ap, msg);
 
-                    if (SHRN_STRNCMP(color, "red", 3) == 0)
-                        SUTLStringAppendP(val, "31");
-                    else if (SHRN_STRNCMP(color, "grn", 3) == 0)
-                        SUTLStringAppendP(val, "32");
-                    else if (SHRN_STRNCMP(color, "blu", 3) == 0)
-                        SUTLStringAppendP(val, "34");
-                    else if (SHRN_STRNCMP(color, "ylw", 3) == 0)
-                        SUTLStringAppendP(val, "33");
-                    else if (SHRN_STRNCMP(color, "cyn", 3) == 0)
-                        SUTLStringAppendP(val, "36");
-                    else if (SHRN_STRNCMP(color, "pnk", 3) == 0)
-                        SUTLStringAppendP(val, "35");
-                    else
-                        SUTLStringAppendP(val, "0");
+            for (i = 0; i < count; i++)
+                fields[i] = va_arg(ap, SLOGField);
 
-                    if (style[0] == 'b')
-                    {
-                        SUTLStringAppendP(val, ";1");
-                    }
+            va_end(ap);
 
-                    if (style[1] == 'i')
-                    {
-                        SUTLStringAppendP(val, ";3");
-                    }
+            SLOG_InternalLogFields(site->Level, site, msg, fields, count);
+        }
 
-                    SUTLStringAppendP(val, "m");
+        SLOG_InternalArenaLeave(state);
+    }
 
-                    value->Value = val;
-                    value->Size = i - value->Location;
+    size_t SLOGGetSiteCount()
+    {
+        return SLOG_INTERNAL_ATOMIC_LOAD(&SLOGSiteCount);
+    }
 
-                    i--;
+    const SLOGSite * SLOGGetSite(size_t id)
+    {
+        SLOGSite ** chunk;
 
-                    /*
-                     * End of '%' sequence
-                     */
-                    continue;
-                }
+        if (!id || id > SLOG_INTERNAL_SITE_CHUNK * SLOG_INTERNAL_SITE_CHUNKS)
+            return NULL;
 
-                /*
-                 * Parse width
-                 */
-                while (fmt[i] >= '0' && fmt[i] <= '9')
-                {
-                    SUTLStringAppendC(widthStr, fmt[i]);
-                    i++;
-                }
+        id--;
 
-                if (widthStr)
-                {
-                    width = strtol(widthStr, NULL, 10);
-                    SUTLStringFree(widthStr);
-                }
+        chunk = (SLOGSite **)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGSiteChunks[id / SLOG_INTERNAL_SITE_CHUNK]);
 
-                /*
-                 * Parse precision
-                 */
-                if (fmt[i] == '.')
-                {
-                    i++;
+        return chunk ? (const SLOGSite *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&chunk[id % SLOG_INTERNAL_SITE_CHUNK]) : NULL;
+    }
 
-                    while (fmt[i] >= '0' && fmt[i] <= '9')
-                    {
-                        SUTLStringAppendC(precisionStr, fmt[i]);
-                        i++;
-                    }
-                }
+    void SLOGSetSiteEnabled(size_t id, int enabled)
+    {
+        SLOGSite * site = (SLOGSite *)SLOGGetSite(id);
 
-                if (precisionStr)
-                {
-                    precision = strtol(precisionStr, NULL, 10);
-                    SUTLStringFree(precisionStr);
-                }
+        if (site)
+            SLOG_INTERNAL_ATOMIC_STORE_INT(&site->Disabled, !enabled);
+    }
 
-                /*
-                 * Parse modifier flags
-                 */
-                switch (fmt[i])
-                {
-                    case 'o': o = 1; i++; break;
-                    case 'x': x = 1; i++; break;
-                }
+    #ifdef _WIN32
+        #define SLOG_INTERNAL_FILE_FD(file) ((SLOG_InternalFd)_get_osfhandle(_fileno(file)))
+    #else
+        #define SLOG_INTERNAL_FILE_FD(file) fileno(file)
+    #endif
 
-                switch (fmt[i])
-                {
-                    case 'l': l = 1; i++; break;
-                    case 'z': z = 1; i++; break;
-                }
+    /*
+     * Buffer of SLOGEmergencyFlush, bytes are collected in 'Data' to save writes.
+     */
+    typedef struct SLOG_InternalEmergency
+    {
+        SLOG_InternalFd Fd;
+        size_t Size;
+        char Data[4096];
+    } SLOG_InternalEmergency;
 
-                /*
-                 * Process arg types
-                 */
-                switch(fmt[i])
-                {
-                    case 'b':
-                    {
-                        int b = va_arg(ap, int);
+    void SLOG_InternalEmergencyWrite(SLOG_InternalEmergency * emergency)
+    {
+        SLOG_InternalFdWrite(emergency->Fd, emergency->Data, emergency->Size);
 
-                        value->Value = SUTLStringNew();
-                        SUTLStringAppendP(value->Value, b ? "true" : "false");
+        emergency->Size = 0;
+    }
 
-                        break;
-                    }
+    void SLOG_InternalEmergencyAppend(SLOG_InternalEmergency * emergency, const char * data, size_t size)
+    {
+        if (emergency->Size + size > sizeof(emergency->Data))
+            SLOG_InternalEmergencyWrite(emergency);
 
-                    case 'c':
-                    {
-                        char c = va_arg(ap, int);
+        if (size > sizeof(emergency->Data))
+        {
+            SLOG_InternalFdWrite(emergency->Fd, data, size);
+        }
+        else
+        {
+            SHRN_MEMCPY(emergency->Data + emergency->Size, data, size);
+            emergency->Size += size;
+        }
+    }
 
-                        char str[] = {c, 0};
+    /*
+     * Cut a text log rendered past the capacity of 'out' after its last line
+     * that fits, and end it with a line saying it was truncated.
+     */
+    void SLOG_InternalEmergencyTruncate(SLOG_InternalBuffer * out)
+    {
+        static const char marker[] = "[truncated]\n";
 
-                        value->Value = SUTLStringNew();
-                        SUTLStringAppendP(value->Value, str);
+        size_t end = out->Capacity - (sizeof(marker) - 1);
 
-                        break;
-                    }
+        while (end && out->Data[end - 1] != '\n')
+            end--;
 
-                    case 'd':
-                    case 'i':
-                    {
-                        unsigned int base = 10;
+        /*
+         * The first line alone doesn't fit, cut it and end it before the marker.
+         */
+        if (!end)
+        {
+            end = out->Capacity - sizeof(marker);
+            out->Data[end++] = '\n';
+        }
 
-                        if (o)
-                            base = 8;
-                        else if (x)
-                            base = 16;
+        SHRN_MEMCPY(out->Data + end, marker, sizeof(marker) - 1);
+        out->Size = end + sizeof(marker) - 1;
+    }
 
-                        if (l)
-                        {
-                            long l = va_arg(ap, long);
+    void SLOGEmergencyFlush()
+    {
+        static size_t flushing = 0;
 
-                            value->Value = SLOG_InternalToStringL(l, base, width);
-                        }
-                        else if (z)
-                        {
-                            ssize_t s = va_arg(ap, ssize_t);
+        SLOG_InternalEmergency emergency;
 
-                            value->Value = SLOG_InternalToStringL(s, base, width);
-                        }
-                        else
-                        {
-                            int i = va_arg(ap, int);
+        FILE * file = (FILE *)SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGOutFile);
 
-                            value->Value = SLOG_InternalToStringI(i, base, width);
-                        }
+        size_t unflushed = 0;
 
-                        break;
-                    }
+        /*
+         * Only the first crashing thread writes.
+         */
+        if (!SLOG_INTERNAL_ATOMIC_CAS(&flushing, &unflushed, 1) || !file)
+            return;
 
-                    case 'f':
-                    {
-                        double d = va_arg(ap, double);
+        emergency.Size = 0;
 
-                        value->Value = SLOG_InternalToStringD(d, precision);
+        /*
+         * The buffer may be in the middle of being written, the logs in it come first either way.
+         */
+        if (SLOGFlushSize && SLOGPending.Size && SLOGPending.File)
+        {
+            emergency.Fd = SLOG_INTERNAL_FILE_FD(SLOGPending.File);
 
-                        break;
-                    }
+            if (SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGBinaryPending) == SLOGPending.File)
+            {
+                SLOG_INTERNAL_ATOMIC_STORE_PTR(&SLOGBinaryPending, NULL);
+                SLOG_InternalFdWrite(emergency.Fd, SLOG_INTERNAL_BINARY_MAGIC, SLOG_INTERNAL_BINARY_MAGIC_SIZE);
+            }
 
-                    case 'p':
-                    {
-                        void * p = va_arg(ap, void *);
+            SLOG_InternalFdWrite(emergency.Fd, SLOGPending.Data, SLOGPending.Size);
+        }
 
-                        value->Value = SLOG_InternalToStringUL((unsigned long)p, 16, -1);
+        emergency.Fd = SLOG_INTERNAL_FILE_FD(file);
 
-                        break;
-                    }
+        if (SLOG_INTERNAL_ATOMIC_LOAD_PTR(&SLOGBinaryPending) == file)
+        {
+            SLOG_INTERNAL_ATOMIC_STORE_PTR(&SLOGBinaryPending, NULL);
+            SLOG_InternalEmergencyAppend(&emergency, SLOG_INTERNAL_BINARY_MAGIC, SLOG_INTERNAL_BINARY_MAGIC_SIZE);
+        }
 
-                    case 's':
-                    {
-                        char * str = va_arg(ap, char *);
+    #ifndef SLOG_NO_THREADS
+        if (SLOG_INTERNAL_ATOMIC_LOAD(&SLOGAsync.Running))
+        {
+            SLOG_InternalQueue * queue = &SLOGAsync.Queue;
 
-                        value->Value = SUTLStringNew();
-                        SUTLStringAppendP(value->Value, str);
+            size_t pos;
 
-                        break;
-                    }
+            for (pos = SLOG_INTERNAL_ATOMIC_LOAD(&queue->Tail);; pos++)
+            {
+                SLOG_InternalRecord * record = SLOG_InternalQueueAt(queue, pos);
 
-                    case 'u':
-                    {
-                        unsigned int base = 10;
+                if (SLOG_INTERNAL_ATOMIC_LOAD(&record->Sequence) != pos + 1)
+                    break;
 
-                        if (o)
-                            base = 8;
-                        else if (x)
-                            base = 16;
+                if (record->Deferred)
+                {
+                    /*
+                     * Render into the rest of the buffer, or into all of it if that is too small.
+                     */
+                    SLOG_InternalBuffer out;
 
-                        if (l)
-                        {
-                            unsigned long l = va_arg(ap, unsigned long);
+                    out.Data = emergency.Data + emergency.Size;
+                    out.Size = 0;
+                    out.Capacity = sizeof(emergency.Data) - emergency.Size;
+                    out.Growable = 0;
+                    out.Color = SLOG_INTERNAL_ATOMIC_LOAD_INT(&SLOGColorEnabled);
 
-                            value->Value = SLOG_InternalToStringUL(l, base, width);
-                        }
-                        else if (z)
-                        {
-                            size_t s = va_arg(ap, size_t);
+                    SLOG_InternalRenderDeferred(&out, record, 0);
 
-                            value->Value = SLOG_InternalToStringUL(s, base, width);
-                        }
-                        else
-                        {
-                            unsigned int i = va_arg(ap, unsigned int);
+                    if (out.Size > out.Capacity && emergency.Size)
+                    {
+                        SLOG_InternalEmergencyWrite(&emergency);
 
-                            value->Value = SLOG_InternalToStringUI(i, base, width);
-                        }
+                        out.Data = emergency.Data;
+                        out.Size = 0;
+                        out.Capacity = sizeof(emergency.Data);
 
-                        break;
+                        SLOG_InternalRenderDeferred(&out, record, 0);
                     }
 
-                    case '%':
+                    if (out.Size > out.Capacity)
                     {
-                        value->Value = SUTLStringNew();
-                        SUTLStringAppendP(value->Value, "%");
+                        /*
+                         * Part of a binary entry would leave slog-decode out of sync for the rest of the file.
+                         */
+                        if (SLOGBinary)
+                            continue;
 
-                        break;
+                        SLOG_InternalEmergencyTruncate(&out);
                     }
-                }
 
-                value->Size = i - value->Location + 1;
+                    emergency.Size += out.Size;
+                }
+                else
+                {
+                    SLOG_InternalEmergencyAppend(&emergency, (const char *)(record + 1), record->Size);
+                }
             }
         }
+    #endif
 
-        char * res = SUTLStringNew();
-        SUTLStringAppendP(res, fmt);
+        SLOG_InternalEmergencyWrite(&emergency);
+    }
 
-        ssize_t offset = 0;
+    static const int SLOG_InternalCrashSignals[] =
+    {
+        SIGSEGV,
+        SIGABRT,
+    #ifdef SIGBUS
+        SIGBUS,
+    #endif
+        SIGFPE
+    };
 
-        for (i = 0; i < SUTLVectorSize(values); i++)
-        {
-            ArgValue value = values[i];
+    #define SLOG_INTERNAL_CRASH_SIGNAL_COUNT (sizeof(SLOG_InternalCrashSignals) / sizeof(SLOG_InternalCrashSignals[0]))
 
-            value.Location += offset;
+    #ifdef _WIN32
+        static void (*SLOGPreviousHandlers[SLOG_INTERNAL_CRASH_SIGNAL_COUNT])(int);
+        static LPTOP_LEVEL_EXCEPTION_FILTER SLOGPreviousFilter = NULL;
 
-            size_t argSize = SUTLStringSize(value.Value);
+        void SLOG_InternalCrashHandler(int sig)
+        {
+            size_t i;
 
-            if (argSize == value.Size)
-            {
-                SHRN_MEMCPY(res + value.Location, value.Value, argSize);
-            }
-            else if (argSize < value.Size)
-            {
-                SUTLStringEraseN(res, value.Location, value.Size);
-                SUTLStringInsertN(res, value.Location, value.Value, argSize);
+            SLOGEmergencyFlush();
 
-                offset -= value.Size - argSize;
-            }
-            else if (argSize > value.Size)
+            for (i = 0; i < SLOG_INTERNAL_CRASH_SIGNAL_COUNT; i++)
             {
-                SUTLStringEraseN(res, value.Location, value.Size);
-                SUTLStringInsertN(res, value.Location, value.Value, argSize);
-
-                offset += argSize - value.Size;
+                if (SLOG_InternalCrashSignals[i] == sig)
+                    signal(sig, SLOGPreviousHandlers[i]);
             }
 
-            SUTLStringFree(value.Value);
+            raise(sig);
         }
 
-        SUTLVectorFree(values);
+        /*
+         * Access violations and other exceptions don't go through the C signals.
+         */
+        LONG WINAPI SLOG_InternalCrashFilter(EXCEPTION_POINTERS * info)
+        {
+            SLOGEmergencyFlush();
 
-        return res;
-    }
+            return SLOGPreviousFilter ? SLOGPreviousFilter(info) : EXCEPTION_CONTINUE_SEARCH;
+        }
 
-    #ifdef _WIN32
-        #include <windows.h>
-    #endif
+        void SLOGInstallCrashHandler()
+        {
+            size_t i;
 
-    static FILE * SLOGOutFile;
-    static int SLOGLogFilterLevel = 0;
+            for (i = 0; i < SLOG_INTERNAL_CRASH_SIGNAL_COUNT; i++)
+                SLOGPreviousHandlers[i] = signal(SLOG_InternalCrashSignals[i], SLOG_InternalCrashHandler);
 
-    #ifdef _WIN32
-        static void InitializeWin32Console()
-        {
-            HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+            SLOGPreviousFilter = SetUnhandledExceptionFilter(SLOG_InternalCrashFilter);
+        }
+    #else
+        static struct sigaction SLOGPreviousActions[SLOG_INTERNAL_CRASH_SIGNAL_COUNT];
 
-            DWORD consoleMode = 0;
+        void SLOG_InternalCrashHandler(int sig)
+        {
+            size_t i;
 
-            GetConsoleMode(hConsole, &consoleMode);
+            SLOGEmergencyFlush();
 
-            if (!(consoleMode & ENABLE_VIRTUAL_TERMINAL_PROCESSING))
+            /*
+             * The signal is blocked while the handler runs, it is delivered
+             * to the previous handler once this returns. Faults happen again
+             * when the faulting instruction is retried.
+             */
+            for (i = 0; i < SLOG_INTERNAL_CRASH_SIGNAL_COUNT; i++)
             {
-                consoleMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
-                SetConsoleMode(hConsole, consoleMode);
+                if (SLOG_InternalCrashSignals[i] == sig)
+                    sigaction(sig, &SLOGPreviousActions[i], NULL);
             }
+
+            raise(sig);
         }
-    #endif
 
-    void SLOGInit()
-    {
-        SLOGOutFile = stdout;
+        void SLOGInstallCrashHandler()
+        {
+            static int installed = 0;
 
-    #ifdef _WIN32
-        InitWin32Console();
-    #endif
-    }
+            struct sigaction action;
 
-    void SLOGSetLogFilterLevel(int level)
-    {
-        SLOGLogFilterLevel = level;
-    }
+            size_t i;
 
-    void SLOGSetOutputFile(FILE * f)
-    {
-        if (f)
-            SLOGOutFile = f;
-    }
+            if (installed)
+                return;
 
-    void SLOGLog(int level, const char * prefix, const char * msg)
-    {
-        if (level >= SLOGLogFilterLevel)
-        {
-            char * log = SLOGFormat("%s %s%=whtxx", prefix, msg);
+            installed = 1;
+
+            SHRN_MEMSET(&action, 0, sizeof(action));
+
+            action.sa_handler = SLOG_InternalCrashHandler;
 
-            fputs(log, SLOGOutFile);
+        #ifdef SA_ONSTACK
+            {
+                stack_t stack;
+
+                stack.ss_size = 65536;
+                stack.ss_sp = SHRN_MALLOC(stack.ss_size);
+                stack.ss_flags = 0;
+
+                if (stack.ss_sp && sigaltstack(&stack, NULL) == 0)
+                    action.sa_flags = SA_ONSTACK;
+            }
+        #endif
+
+            sigemptyset(&action.sa_mask);
 
-            SUTLStringFree(log);
+            for (i = 0; i < SLOG_INTERNAL_CRASH_SIGNAL_COUNT; i++)
+                sigaction(SLOG_InternalCrashSignals[i], &action, &SLOGPreviousActions[i]);
         }
-    }
+    #endif
 #endif
 
 #endif
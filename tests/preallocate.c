@@ -0,0 +1,129 @@
+/*
+ * Checks that with SLOGConfig::Preallocate, logging never allocates.
+ *
+ * Logs of every kind are written from several threads through the deferred
+ * asynchronous queue to a JSON output file and a logfmt sink, and the
+ * allocation count of SLOGGetStats must still be 0 afterwards.
+ */
+#define SLOG_IMPLEMENTATION
+#include "Shroon/Logger/Logger.h"
+
+#include <string.h>
+
+#define TEST_THREADS 4
+#define TEST_LOGS    1000
+
+static void SinkWrite(void * user, int level, const char * data, size_t size)
+{
+    (void)level;
+
+    fwrite(data, 1, size, (FILE *)user);
+}
+
+static SLOG_INTERNAL_THREAD_RESULT Run(void * arg)
+{
+    int id = (int)(size_t)arg;
+    int i;
+
+    for (i = 0; i < TEST_LOGS; i++)
+    {
+        SLOG_INFO("thread %d log %d value %f name %s\n", id, i, i * 0.25, "preallocated");
+        SLOG_WARN_FIELDS("fields", SLOGFieldInt("thread", id), SLOGFieldFloat("ratio", i / 3.0), SLOGFieldString("name", "x y"));
+
+        if (i % 100 == 0)
+            SLOGLog(SLOG_LEVEL_ERROR, "[ERROR]", "direct\n");
+    }
+
+    return 0;
+}
+
+static int Contains(FILE * f, const char * text)
+{
+    static char data[1 << 20];
+    size_t size;
+
+    fflush(f);
+    rewind(f);
+    size = fread(data, 1, sizeof(data) - 1, f);
+    data[size] = '\0';
+
+    return strstr(data, text) != NULL;
+}
+
+int main(void)
+{
+    SLOG_InternalThread threads[TEST_THREADS];
+
+    SLOGConfig config;
+    SLOGStats stats;
+    SLOGSink sink;
+
+    FILE * out = tmpfile();
+    FILE * logfmt = tmpfile();
+
+    size_t i;
+
+    int failed = 0;
+
+    if (!out || !logfmt)
+    {
+        perror("tmpfile");
+        return 1;
+    }
+
+    SLOGGetDefaultConfig(&config);
+    config.Preallocate = 1;
+    config.Async = 1;
+    config.Deferred = 1;
+    config.Encoding = SLOG_ENCODING_JSON;
+    config.Threads = TEST_THREADS + 2;
+    SLOGInitWithConfig(&config);
+    SLOGSetColorMode(SLOG_COLOR_NEVER);
+    SLOGSetOutputFile(out);
+
+    SHRN_MEMSET(&sink, 0, sizeof(sink));
+    sink.Write = SinkWrite;
+    sink.User = logfmt;
+    sink.Levels = SLOG_LEVELS_FROM(SLOG_LEVEL_TRACE);
+    sink.Encoding = SLOG_ENCODING_LOGFMT;
+    SLOGAddSink(&sink);
+
+    for (i = 0; i < TEST_THREADS; i++)
+    {
+        if (!SLOG_InternalThreadStart(&threads[i], Run, (void *)i))
+        {
+            fprintf(stderr, "Failed to start thread %u.\n", (unsigned)i);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < TEST_THREADS; i++)
+        SLOG_InternalThreadJoin(threads[i]);
+
+    SLOGFlush();
+    SLOGGetStats(&stats);
+
+    if (stats.Allocations)
+    {
+        fprintf(stderr, "%u allocations of %u bytes after initialization.\n", (unsigned)stats.Allocations, (unsigned)stats.AllocatedBytes);
+        failed = 1;
+    }
+
+    if (!stats.PreallocatedBytes)
+    {
+        fprintf(stderr, "Nothing was preallocated.\n");
+        failed = 1;
+    }
+
+    if (!Contains(out, "\"msg\":\"thread 3 log 999 value 249.75") || !Contains(logfmt, "msg=fields thread=3"))
+    {
+        fprintf(stderr, "Missing logs.\n");
+        failed = 1;
+    }
+
+    SLOGShutdown();
+    fclose(logfmt);
+    fclose(out);
+
+    return failed;
+}
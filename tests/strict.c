@@ -0,0 +1,63 @@
+/*
+ * Builds the implementation in strict ISO C mode, without the compiler's
+ * extensions, and checks that logs of every path still reach the output file.
+ */
+#define SLOG_IMPLEMENTATION
+#include "Shroon/Logger/Logger.h"
+
+#include <string.h>
+
+static int Contains(FILE * f, const char * text)
+{
+    static char data[65536];
+    size_t size;
+
+    fflush(f);
+    rewind(f);
+    size = fread(data, 1, sizeof(data) - 1, f);
+    data[size] = '\0';
+
+    return strstr(data, text) != NULL;
+}
+
+int main(void)
+{
+    SLOGConfig config;
+    FILE * out = tmpfile();
+    int failed = 0;
+
+    if (!out)
+    {
+        perror("tmpfile");
+        return 1;
+    }
+
+    SLOGGetDefaultConfig(&config);
+    config.Async = 1;
+    config.Deferred = 1;
+    config.TimestampDigits = 9;
+    SLOGInitWithConfig(&config);
+    SLOGSetColorMode(SLOG_COLOR_NEVER);
+    SLOGSetOutputFile(out);
+
+    SLOG_INFO("strict %d %s\n", 42, "deferred");
+    SLOGLog(SLOG_LEVEL_WARN, "[WARN]", "strict direct\n");
+    SLOGFlush();
+
+    if (!Contains(out, "strict 42 deferred"))
+    {
+        fprintf(stderr, "missing deferred log\n");
+        failed = 1;
+    }
+
+    if (!Contains(out, "strict direct"))
+    {
+        fprintf(stderr, "missing direct log\n");
+        failed = 1;
+    }
+
+    SLOGShutdown();
+    fclose(out);
+
+    return failed;
+}
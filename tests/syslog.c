@@ -0,0 +1,314 @@
+/*
+ * Points a syslog sink at a datagram socket bound in a temporary directory
+ * and checks the RFC 5424 and journald datagrams it receives.
+ *
+ * Logs are written in bursts that fill most of a batch, which the sender
+ * thread sends with one sendmmsg call. Each burst is received before the
+ * next one is written, so none may be dropped: every log must arrive as a
+ * datagram of its own, in order.
+ */
+#define SLOG_IMPLEMENTATION
+#include "Shroon/Logger/Logger.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define TEST_LOGS      200
+#define TEST_BURST     50
+#define TEST_DATAGRAMS (TEST_LOGS + 2)
+#define TEST_FACILITY  16
+
+typedef struct TestListener
+{
+    int Fd;
+    size_t Count;
+    size_t Sizes[TEST_DATAGRAMS];
+    char Data[TEST_DATAGRAMS][SLOG_INTERNAL_SYSLOG_MAX];
+} TestListener;
+
+static TestListener Listener;
+
+static int Failed = 0;
+
+static void Fail(const char * protocol, size_t index, const char * what)
+{
+    fprintf(stderr, "%s datagram %u: %s\n", protocol, (unsigned)index, what);
+    Failed = 1;
+}
+
+/*
+ * Receive datagrams until every expected one arrived or none came for 2 seconds.
+ */
+static SLOG_INTERNAL_THREAD_RESULT Listen(void * arg)
+{
+    (void)arg;
+
+    while (Listener.Count < TEST_DATAGRAMS)
+    {
+        struct pollfd readable;
+
+        ssize_t size;
+
+        readable.fd = Listener.Fd;
+        readable.events = POLLIN;
+
+        if (poll(&readable, 1, 2000) <= 0)
+            break;
+
+        size = recv(Listener.Fd, Listener.Data[Listener.Count], sizeof(Listener.Data[0]), 0);
+
+        if (size < 0)
+            break;
+
+        Listener.Sizes[Listener.Count] = (size_t)size;
+        SLOG_INTERNAL_ATOMIC_STORE(&Listener.Count, Listener.Count + 1);
+    }
+
+    return 0;
+}
+
+/*
+ * Wait up to 2 seconds until 'count' datagrams were received.
+ */
+static void WaitFor(size_t count)
+{
+    int i;
+
+    for (i = 0; i < 2000 && SLOG_INTERNAL_ATOMIC_LOAD(&Listener.Count) < count; i++)
+        poll(NULL, 0, 1);
+}
+
+static int Bind(const char * path)
+{
+    struct sockaddr_un address;
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+    if (fd < 0)
+        return -1;
+
+    SHRN_MEMSET(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    SHRN_MEMCPY(address.sun_path, path, SHRN_STRLEN(path));
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Send the logs of the test through a sink of 'protocol' listening at 'path'.
+ */
+static int Run(const char * path, int protocol)
+{
+    SLOG_InternalThread listener;
+
+    SLOGSyslogSink * syslog;
+    SLOGSink sink;
+
+    int id;
+    int i;
+
+    Listener.Count = 0;
+    Listener.Fd = Bind(path);
+
+    if (Listener.Fd < 0)
+    {
+        perror("bind");
+        return 0;
+    }
+
+    if (!SLOG_InternalThreadStart(&listener, Listen, NULL))
+    {
+        close(Listener.Fd);
+        return 0;
+    }
+
+    syslog = SLOGOpenSyslogSink(path, protocol, "test app", TEST_FACILITY);
+
+    if (!syslog)
+    {
+        fprintf(stderr, "Failed to open the sink at %s.\n", path);
+        SLOG_InternalThreadJoin(listener);
+        close(Listener.Fd);
+        return 0;
+    }
+
+    SHRN_MEMSET(&sink, 0, sizeof(sink));
+    sink.Write = SLOGSyslogSinkWrite;
+    sink.User = syslog;
+    sink.Levels = SLOG_LEVELS_FROM(SLOG_LEVEL_TRACE);
+    sink.Encoding = SLOG_ENCODING_TEXT;
+
+    id = SLOGAddSink(&sink);
+
+    for (i = 0; i < TEST_LOGS; i++)
+    {
+        SLOG_INFO("message %d\n", i);
+
+        if ((i + 1) % TEST_BURST == 0)
+            WaitFor((size_t)i + 1);
+    }
+
+    SLOG_ERROR("multi\nline error\n");
+    SLOG_DEBUG("debug\n");
+
+    SLOGRemoveSink(id);
+
+    if (SLOGGetSyslogSinkDropped(syslog))
+    {
+        fprintf(stderr, "%s: %u logs dropped.\n", path, (unsigned)SLOGGetSyslogSinkDropped(syslog));
+        Failed = 1;
+    }
+
+    SLOGCloseSyslogSink(syslog);
+
+    SLOG_InternalThreadJoin(listener);
+    close(Listener.Fd);
+    unlink(path);
+
+    if (Listener.Count != TEST_DATAGRAMS)
+    {
+        fprintf(stderr, "%s: received %u of %u datagrams.\n", path, (unsigned)Listener.Count, TEST_DATAGRAMS);
+        Failed = 1;
+    }
+
+    return 1;
+}
+
+/*
+ * Check '<priority>1 - <host> test_app <pid> - - <message>'.
+ */
+static void CheckRfc5424(const char * host)
+{
+    char expected[512];
+
+    size_t i;
+
+    for (i = 0; i < Listener.Count; i++)
+    {
+        int severity = i < TEST_LOGS ? 6 : i == TEST_LOGS ? 3 : 7;
+
+        int size;
+
+        if (i < TEST_LOGS)
+            size = sprintf(expected, "<%d>1 - %s test_app %d - - Info: message %u", TEST_FACILITY * 8 + severity, host, (int)getpid(), (unsigned)i);
+        else if (i == TEST_LOGS)
+            size = sprintf(expected, "<%d>1 - %s test_app %d - - Error: multi\nline error", TEST_FACILITY * 8 + severity, host, (int)getpid());
+        else
+            size = sprintf(expected, "<%d>1 - %s test_app %d - - Debug: debug", TEST_FACILITY * 8 + severity, host, (int)getpid());
+
+        if (Listener.Sizes[i] != (size_t)size || memcmp(Listener.Data[i], expected, (size_t)size) != 0)
+            Fail("RFC 5424", i, "unexpected message");
+    }
+}
+
+/*
+ * Check 'PRIORITY=', the fields of the sink and 'MESSAGE=', or the binary
+ * 'MESSAGE' field for messages with newlines.
+ */
+static void CheckJournald()
+{
+    char expected[512];
+    char message[64];
+
+    size_t i;
+
+    for (i = 0; i < Listener.Count; i++)
+    {
+        const char * data = Listener.Data[i];
+
+        int severity = i < TEST_LOGS ? 6 : i == TEST_LOGS ? 3 : 7;
+
+        int size = sprintf(expected, "PRIORITY=%d\nSYSLOG_FACILITY=%d\nSYSLOG_IDENTIFIER=test app\nSYSLOG_PID=%d\n", severity, TEST_FACILITY, (int)getpid());
+
+        int length;
+
+        if (Listener.Sizes[i] < (size_t)size || memcmp(data, expected, (size_t)size) != 0)
+        {
+            Fail("journald", i, "unexpected fields");
+            continue;
+        }
+
+        data += size;
+
+        if (i == TEST_LOGS)
+        {
+            static const char text[] = "Error: multi\nline error";
+
+            uint64_t value = 0;
+
+            int k;
+
+            for (k = 0; k < 8; k++)
+                value |= (uint64_t)(unsigned char)data[8 + k] << (k * 8);
+
+            if (Listener.Sizes[i] != (size_t)size + 8 + 8 + sizeof(text) - 1 + 1 || memcmp(data, "MESSAGE\n", 8) != 0
+                || value != sizeof(text) - 1 || memcmp(data + 16, text, sizeof(text) - 1) != 0 || data[16 + sizeof(text) - 1] != '\n')
+                Fail("journald", i, "unexpected binary message");
+
+            continue;
+        }
+
+        if (i < TEST_LOGS)
+            length = sprintf(message, "MESSAGE=Info: message %u\n", (unsigned)i);
+        else
+            length = sprintf(message, "MESSAGE=Debug: debug\n");
+
+        if (Listener.Sizes[i] != (size_t)(size + length) || memcmp(data, message, (size_t)length) != 0)
+            Fail("journald", i, "unexpected message");
+    }
+}
+
+int main(void)
+{
+    char directory[] = "/tmp/slog-test-XXXXXX";
+    char path[256];
+    char host[256];
+
+    SLOGConfig config;
+
+    if (!mkdtemp(directory))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    if (gethostname(host, sizeof(host)) != 0 || !host[0])
+        strcpy(host, "-");
+
+    host[sizeof(host) - 1] = 0;
+
+    SLOGGetDefaultConfig(&config);
+    config.TimestampDigits = -1;
+    config.FlushIntervalMs = 10;
+    SLOGInitWithConfig(&config);
+
+    /*
+     * Only the sinks take logs.
+     */
+    SLOGSetLogFilterLevel(SLOG_LEVEL_COUNT);
+
+    sprintf(path, "%s/rfc5424.sock", directory);
+
+    if (Run(path, SLOG_SYSLOG_RFC5424))
+        CheckRfc5424(host);
+    else
+        Failed = 1;
+
+    sprintf(path, "%s/journald.sock", directory);
+
+    if (Run(path, SLOG_SYSLOG_JOURNALD))
+        CheckJournald();
+    else
+        Failed = 1;
+
+    SLOGShutdown();
+    rmdir(directory);
+
+    return Failed;
+}
@@ -0,0 +1,636 @@
+/*
+ * slog-decode: Turns binary log files written with SLOGConfig::Binary back into text.
+ *
+ * The file is mapped into memory and scanned once for entry boundaries and
+ * formats, then split into chunks that are decoded in parallel and written
+ * in order. Filtered out entries are skipped without rendering them.
+ */
+#define SLOG_IMPLEMENTATION
+#include "Shroon/Logger/Logger.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct Options
+{
+    const char * Path;
+    int MinLevel;
+    uint64_t Since;
+    uint64_t Until;
+    int Threads;
+    int Color;
+    int Time;
+    int Follow;
+} Options;
+
+static Options Opts;
+
+/*
+ * Programs of the formats defined so far, indexed by format id.
+ */
+typedef struct Formats
+{
+    SLOGFormatProgram ** Programs;
+    size_t Count;
+} Formats;
+
+/*
+ * A FORMAT entry compiled while scanning, in file order.
+ */
+typedef struct Definition
+{
+    uint32_t Id;
+    SLOGFormatProgram * Program;
+} Definition;
+
+typedef struct Chunk
+{
+    size_t Begin;
+    size_t End;
+    size_t FirstDefinition; /* Index of the first definition inside the chunk. */
+    Formats Formats;        /* Formats defined before the chunk. */
+    SLOG_InternalBuffer Out;
+    int Done;
+} Chunk;
+
+typedef struct Decoder
+{
+    const char * Data;
+    Formats Formats;
+    Definition * Definitions;
+    size_t DefinitionCount;
+    size_t DefinitionCapacity;
+    Chunk * Chunks;
+    size_t ChunkCount;
+    size_t NextChunk;
+    pthread_mutex_t Mutex;
+    pthread_cond_t ChunkDone;
+} Decoder;
+
+static void FormatsSet(Formats * formats, uint32_t id, SLOGFormatProgram * program)
+{
+    if (id >= formats->Count)
+    {
+        size_t count = formats->Count ? formats->Count * 2 : 64;
+
+        while (id >= count)
+            count *= 2;
+
+        formats->Programs = (SLOGFormatProgram **)realloc(formats->Programs, count * sizeof(SLOGFormatProgram *));
+        memset(formats->Programs + formats->Count, 0, (count - formats->Count) * sizeof(SLOGFormatProgram *));
+
+        formats->Count = count;
+    }
+
+    formats->Programs[id] = program;
+}
+
+static Formats FormatsCopy(const Formats * formats)
+{
+    Formats copy;
+
+    copy.Count = formats->Count;
+    copy.Programs = (SLOGFormatProgram **)malloc(formats->Count * sizeof(SLOGFormatProgram *) + 1);
+
+    if (formats->Count)
+        memcpy(copy.Programs, formats->Programs, formats->Count * sizeof(SLOGFormatProgram *));
+
+    return copy;
+}
+
+static uint32_t ReadU32(const char * data)
+{
+    uint32_t val;
+
+    memcpy(&val, data, sizeof(val));
+
+    return val;
+}
+
+static uint64_t ReadU64(const char * data)
+{
+    uint64_t val;
+
+    memcpy(&val, data, sizeof(val));
+
+    return val;
+}
+
+/*
+ * Size of the entry at 'data', 0 if it isn't complete in the 'available' bytes.
+ */
+static size_t EntrySize(const char * data, size_t available)
+{
+    uint32_t size;
+
+    if (available < SLOG_INTERNAL_ENTRY_HEADER_SIZE)
+        return 0;
+
+    size = ReadU32(data);
+
+    if (size == 0 || size > available - 4)
+        return 0;
+
+    return (size_t)size + 4;
+}
+
+/*
+ * Size of the arguments of 'program' at 'args', or more than 'size' if they
+ * don't fit in 'size' bytes.
+ */
+static size_t CapturedSize(const SLOGFormatProgram * program, const char * args, size_t size)
+{
+    size_t i = 0;
+    size_t used = 0;
+
+    for (i = 0; i < program->OpCount; i++)
+    {
+        switch (program->Ops[i].Kind)
+        {
+            case SLOG_INTERNAL_SPEC_LITERAL:
+            case SLOG_INTERNAL_SPEC_ESCAPE:
+                break;
+
+            case SLOG_INTERNAL_SPEC_STRING:
+            {
+                if (used + 4 > size)
+                    return size + 1;
+
+                used += 4 + (size_t)ReadU32(args + used);
+
+                break;
+            }
+
+            default:
+            {
+                used += sizeof(SLOG_InternalArg);
+
+                break;
+            }
+        }
+
+        if (used > size)
+            return size + 1;
+    }
+
+    return used;
+}
+
+static int Matches(int level, uint64_t time)
+{
+    return level >= Opts.MinLevel && time >= Opts.Since && time <= Opts.Until;
+}
+
+static void AppendTime(SLOG_InternalBuffer * out, uint64_t time)
+{
+    char text[32];
+
+    time_t seconds = (time_t)(time / 1000000000);
+
+    struct tm local;
+
+    localtime_r(&seconds, &local);
+
+    SLOG_InternalBufferAppend(out, text, strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S.", &local));
+    SLOG_InternalBufferAppendInt(out, time % 1000000000 / 1000, 0, 10, 6, 0);
+    SLOG_InternalBufferAppendC(out, ' ');
+}
+
+static void DecodeLog(SLOG_InternalBuffer * out, const Formats * formats, const char * entry, size_t size)
+{
+    int level;
+
+    uint64_t time;
+    uint32_t id;
+
+    size_t start;
+
+    const SLOGFormatProgram * program;
+
+    if (size < SLOG_INTERNAL_LOG_HEADER_SIZE)
+        return;
+
+    level = (uint8_t)entry[SLOG_INTERNAL_ENTRY_HEADER_SIZE];
+    time = ReadU64(entry + SLOG_INTERNAL_ENTRY_HEADER_SIZE + 1);
+
+    if (!Matches(level, time))
+        return;
+
+    id = ReadU32(entry + SLOG_INTERNAL_TEXT_HEADER_SIZE);
+    program = id < formats->Count ? formats->Programs[id] : NULL;
+
+    if (!program || CapturedSize(program, entry + SLOG_INTERNAL_LOG_HEADER_SIZE, size - SLOG_INTERNAL_LOG_HEADER_SIZE) > size - SLOG_INTERNAL_LOG_HEADER_SIZE)
+    {
+        fprintf(stderr, "slog-decode: Skipped a log with an unknown or mismatching format %u.\n", (unsigned)id);
+        return;
+    }
+
+    if (Opts.Time)
+        AppendTime(out, time);
+
+    start = SLOG_InternalRenderLogBegin(out, SLOG_ENCODING_TEXT, level, NULL, NULL, 0);
+    SLOG_InternalExecuteCaptured(out, program, entry + SLOG_INTERNAL_LOG_HEADER_SIZE);
+    SLOG_InternalRenderLogEnd(out, SLOG_ENCODING_TEXT, start, NULL, 0);
+}
+
+static void DecodeText(SLOG_InternalBuffer * out, const char * entry, size_t size)
+{
+    int level;
+
+    uint64_t time;
+
+    if (size < SLOG_INTERNAL_TEXT_HEADER_SIZE)
+        return;
+
+    level = (uint8_t)entry[SLOG_INTERNAL_ENTRY_HEADER_SIZE];
+    time = ReadU64(entry + SLOG_INTERNAL_ENTRY_HEADER_SIZE + 1);
+
+    if (!Matches(level, time))
+        return;
+
+    if (Opts.Time)
+        AppendTime(out, time);
+
+    SLOG_InternalBufferAppend(out, entry + SLOG_INTERNAL_TEXT_HEADER_SIZE, size - SLOG_INTERNAL_TEXT_HEADER_SIZE);
+
+    /*
+     * SLOGLog resets the color after the message.
+     */
+    SLOG_InternalRenderLogEnd(out, SLOG_ENCODING_TEXT, out->Size, NULL, 0);
+}
+
+static void DecodeChunk(Decoder * decoder, Chunk * chunk)
+{
+    size_t pos = chunk->Begin;
+    size_t definition = chunk->FirstDefinition;
+
+    while (pos < chunk->End)
+    {
+        const char * entry = decoder->Data + pos;
+
+        size_t size = EntrySize(entry, chunk->End - pos);
+
+        switch (entry[4])
+        {
+            case SLOG_INTERNAL_ENTRY_FORMAT:
+            {
+                /*
+                 * Already compiled while scanning.
+                 */
+                FormatsSet(&chunk->Formats, decoder->Definitions[definition].Id, decoder->Definitions[definition].Program);
+                definition++;
+
+                break;
+            }
+
+            case SLOG_INTERNAL_ENTRY_LOG: DecodeLog(&chunk->Out, &chunk->Formats, entry, size); break;
+            case SLOG_INTERNAL_ENTRY_TEXT: DecodeText(&chunk->Out, entry, size); break;
+        }
+
+        pos += size;
+    }
+}
+
+static void * Worker(void * arg)
+{
+    Decoder * decoder = (Decoder *)arg;
+
+    for (;;)
+    {
+        size_t i = SLOG_INTERNAL_ATOMIC_FETCH_ADD(&decoder->NextChunk, 1);
+
+        if (i >= decoder->ChunkCount)
+            break;
+
+        DecodeChunk(decoder, &decoder->Chunks[i]);
+
+        pthread_mutex_lock(&decoder->Mutex);
+        decoder->Chunks[i].Done = 1;
+        pthread_cond_broadcast(&decoder->ChunkDone);
+        pthread_mutex_unlock(&decoder->Mutex);
+    }
+
+    return NULL;
+}
+
+static void AddChunk(Decoder * decoder, size_t begin)
+{
+    Chunk * chunk;
+
+    decoder->Chunks = (Chunk *)realloc(decoder->Chunks, (decoder->ChunkCount + 1) * sizeof(Chunk));
+
+    chunk = &decoder->Chunks[decoder->ChunkCount++];
+
+    chunk->Begin = begin;
+    chunk->End = begin;
+    chunk->FirstDefinition = decoder->DefinitionCount;
+    chunk->Formats = FormatsCopy(&decoder->Formats);
+    chunk->Out.Data = SUTLStringNew();
+    chunk->Out.Size = 0;
+    chunk->Out.Capacity = 0;
+    chunk->Out.Growable = 1;
+    chunk->Out.Color = Opts.Color;
+    chunk->Done = 0;
+}
+
+static void AddDefinition(Decoder * decoder, const char * entry, size_t size)
+{
+    Definition * definition;
+
+    char * format;
+
+    if (size < SLOG_INTERNAL_FORMAT_HEADER_SIZE)
+        return;
+
+    if (decoder->DefinitionCount == decoder->DefinitionCapacity)
+    {
+        decoder->DefinitionCapacity = decoder->DefinitionCapacity ? decoder->DefinitionCapacity * 2 : 64;
+        decoder->Definitions = (Definition *)realloc(decoder->Definitions, decoder->DefinitionCapacity * sizeof(Definition));
+    }
+
+    format = (char *)malloc(size - SLOG_INTERNAL_FORMAT_HEADER_SIZE + 1);
+
+    memcpy(format, entry + SLOG_INTERNAL_FORMAT_HEADER_SIZE, size - SLOG_INTERNAL_FORMAT_HEADER_SIZE);
+    format[size - SLOG_INTERNAL_FORMAT_HEADER_SIZE] = '\0';
+
+    definition = &decoder->Definitions[decoder->DefinitionCount++];
+    definition->Id = ReadU32(entry + SLOG_INTERNAL_ENTRY_HEADER_SIZE);
+    definition->Program = SLOGCompileFormat(format);
+
+    free(format);
+
+    FormatsSet(&decoder->Formats, definition->Id, definition->Program);
+}
+
+/*
+ * Decode the complete entries of 'data' from 'begin' to 'size' and write them
+ * to stdout. Returns the position after the last complete entry.
+ */
+static size_t Decode(Decoder * decoder, const char * data, size_t begin, size_t size)
+{
+    pthread_t * threads;
+
+    size_t chunkSize = (size - begin) / ((size_t)Opts.Threads * 8) + 1;
+    size_t boundary = begin;
+    size_t pos = begin;
+    size_t entry = 0;
+    size_t i = 0;
+
+    decoder->Data = data;
+    decoder->ChunkCount = 0;
+    decoder->NextChunk = 0;
+
+    /*
+     * Find the entry boundaries to split at and compile the formats on the way.
+     */
+    while ((entry = EntrySize(data + pos, size - pos)) != 0)
+    {
+        if (pos >= boundary)
+        {
+            if (decoder->ChunkCount)
+                decoder->Chunks[decoder->ChunkCount - 1].End = pos;
+
+            AddChunk(decoder, pos);
+
+            boundary = pos + chunkSize;
+        }
+
+        if (data[pos + 4] == SLOG_INTERNAL_ENTRY_FORMAT)
+            AddDefinition(decoder, data + pos, entry);
+
+        pos += entry;
+    }
+
+    if (!decoder->ChunkCount)
+        return pos;
+
+    decoder->Chunks[decoder->ChunkCount - 1].End = pos;
+
+    threads = (pthread_t *)malloc(Opts.Threads * sizeof(pthread_t));
+
+    for (i = 0; i < (size_t)Opts.Threads; i++)
+        pthread_create(&threads[i], NULL, Worker, decoder);
+
+    /*
+     * Write the chunks in order as they finish.
+     */
+    for (i = 0; i < decoder->ChunkCount; i++)
+    {
+        Chunk * chunk = &decoder->Chunks[i];
+
+        pthread_mutex_lock(&decoder->Mutex);
+
+        while (!chunk->Done)
+            pthread_cond_wait(&decoder->ChunkDone, &decoder->Mutex);
+
+        pthread_mutex_unlock(&decoder->Mutex);
+
+        fwrite(chunk->Out.Data, 1, chunk->Out.Size, stdout);
+
+        SUTLStringFree(chunk->Out.Data);
+        free(chunk->Formats.Programs);
+    }
+
+    fflush(stdout);
+
+    for (i = 0; i < (size_t)Opts.Threads; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+
+    return pos;
+}
+
+static int ParseLevel(const char * name)
+{
+    static const char * const names[] = { "trace", "debug", "info", "warn", "error", "fatal" };
+
+    int i = 0;
+
+    if (name[0] >= '0' && name[0] <= '5' && !name[1])
+        return name[0] - '0';
+
+    for (i = 0; i < 6; i++)
+    {
+        if (!strncmp(name, names[i], strlen(names[i])))
+            return i;
+    }
+
+    return -1;
+}
+
+static uint64_t ParseTime(const char * seconds)
+{
+    return (uint64_t)(strtod(seconds, NULL) * 1e9);
+}
+
+static void PrintUsage()
+{
+    fputs(
+        "Usage: slog-decode [options] <file>\n"
+        "\n"
+        "Options:\n"
+        "  --level=<level>     Only show logs of <level> or above (trace, debug, info, warn, error, fatal or 0-5).\n"
+        "  --since=<seconds>   Only show logs written at or after a Unix time.\n"
+        "  --until=<seconds>   Only show logs written at or before a Unix time.\n"
+        "  --time              Prefix logs with the time they were written.\n"
+        "  --color=<mode>      Write colors: auto, always or never.\n"
+        "  --threads=<count>   Number of decoding threads.\n"
+        "  --follow            Keep decoding logs appended to the file.\n",
+        stderr);
+}
+
+static int ParseOptions(int argc, char ** argv)
+{
+    int color = SLOG_COLOR_AUTO;
+    int i = 0;
+
+    Opts.Until = (uint64_t)-1;
+    Opts.Threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (i = 1; i < argc; i++)
+    {
+        const char * arg = argv[i];
+
+        if (!strncmp(arg, "--level=", 8))
+        {
+            if ((Opts.MinLevel = ParseLevel(arg + 8)) < 0)
+                return 0;
+        }
+        else if (!strncmp(arg, "--since=", 8))
+        {
+            Opts.Since = ParseTime(arg + 8);
+        }
+        else if (!strncmp(arg, "--until=", 8))
+        {
+            Opts.Until = ParseTime(arg + 8);
+        }
+        else if (!strcmp(arg, "--time"))
+        {
+            Opts.Time = 1;
+        }
+        else if (!strncmp(arg, "--color=", 8))
+        {
+            if (!strcmp(arg + 8, "always"))
+                color = SLOG_COLOR_ALWAYS;
+            else if (!strcmp(arg + 8, "never"))
+                color = SLOG_COLOR_NEVER;
+            else if (strcmp(arg + 8, "auto"))
+                return 0;
+        }
+        else if (!strncmp(arg, "--threads=", 10))
+        {
+            Opts.Threads = atoi(arg + 10);
+        }
+        else if (!strcmp(arg, "--follow"))
+        {
+            Opts.Follow = 1;
+        }
+        else if (arg[0] == '-' || Opts.Path)
+        {
+            return 0;
+        }
+        else
+        {
+            Opts.Path = arg;
+        }
+    }
+
+    if (Opts.Threads < 1)
+        Opts.Threads = 1;
+
+    Opts.Color = color == SLOG_COLOR_ALWAYS || (color == SLOG_COLOR_AUTO && isatty(fileno(stdout)));
+
+    return Opts.Path != NULL;
+}
+
+int main(int argc, char ** argv)
+{
+    Decoder decoder;
+
+    struct stat info;
+
+    size_t pos = SLOG_INTERNAL_BINARY_MAGIC_SIZE;
+
+    int fd;
+
+    if (!ParseOptions(argc, argv))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    fd = open(Opts.Path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        perror(Opts.Path);
+        return 1;
+    }
+
+    memset(&decoder, 0, sizeof(decoder));
+
+    pthread_mutex_init(&decoder.Mutex, NULL);
+    pthread_cond_init(&decoder.ChunkDone, NULL);
+
+    for (;;)
+    {
+        size_t size;
+
+        char * data;
+
+        if (fstat(fd, &info))
+        {
+            perror(Opts.Path);
+            return 1;
+        }
+
+        size = (size_t)info.st_size;
+
+        /*
+         * Start over if the file was truncated.
+         */
+        if (size < pos)
+            pos = SLOG_INTERNAL_BINARY_MAGIC_SIZE;
+
+        if (size > pos)
+        {
+            data = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data == MAP_FAILED)
+            {
+                perror(Opts.Path);
+                return 1;
+            }
+
+            if (memcmp(data, SLOG_INTERNAL_BINARY_MAGIC, SLOG_INTERNAL_BINARY_MAGIC_SIZE))
+            {
+                fprintf(stderr, "%s: Not a binary log file.\n", Opts.Path);
+                return 1;
+            }
+
+            madvise(data, size, MADV_SEQUENTIAL);
+
+            pos = Decode(&decoder, data, pos, size);
+
+            munmap(data, size);
+        }
+        else if (size && size < SLOG_INTERNAL_BINARY_MAGIC_SIZE && !Opts.Follow)
+        {
+            fprintf(stderr, "%s: Not a binary log file.\n", Opts.Path);
+            return 1;
+        }
+
+        if (!Opts.Follow)
+            break;
+
+        usleep(100000);
+    }
+
+    close(fd);
+
+    return 0;
+}